@@ -0,0 +1,500 @@
+#include <QtSql>
+#include <QFile>
+#include <QFileInfo>
+#include "batchcommands.h"
+#include "ledgerexporter.h"
+#include "definitions.h"
+
+#define importChunkSize 5000
+
+//qt 5.15 deprecates the global endl in favor of Qt::endl, which arrived in 5.14
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+#define lineEnd Qt::endl
+#else
+#define lineEnd endl
+#endif
+
+BatchCommands::BatchCommands() :
+    out(stdout),
+    err(stderr),
+    transactions(0)
+{
+}
+
+BatchCommands::~BatchCommands()
+{
+    delete transactions;
+    QSqlDatabase::database().close();
+}
+
+void BatchCommands::addOptions(QCommandLineParser &parser)
+{
+    parser.addOption(QCommandLineOption("db", "Path to the coin database.", "path"));
+    parser.addOption(QCommandLineOption("account", "Account name or pk_uid to work on.", "account"));
+    parser.addOption(QCommandLineOption("format", "Export format: csv, jsonl or columnar.", "format"));
+    parser.addOption(QCommandLineOption("from", "First date to export (yyyy-MM-dd).", "date"));
+    parser.addOption(QCommandLineOption("to", "Last date to export (yyyy-MM-dd).", "date"));
+    parser.addOption(QCommandLineOption("output", "File to export to instead of stdout.", "file"));
+    parser.addOption(QCommandLineOption("min", "Smallest amount a rule applies to.", "amount"));
+    parser.addOption(QCommandLineOption("max", "Largest amount a rule applies to.", "amount"));
+    parser.addPositionalArgument("command",
+                                 "balance | rebuild-balances | import <file.csv> | export | report | "
+                                 "rules | add-rule <pattern> | categorize");
+}
+
+/*
+ *  runs the command named by the first positional argument. returns the process exit code
+ */
+int BatchCommands::run(const QCommandLineParser &parser)
+{
+    QStringList args = parser.positionalArguments();
+    if (args.isEmpty())
+    {
+        err << "No command given, see --help" << lineEnd;
+        return 1;
+    }
+    if (!parser.isSet("db"))
+    {
+        err << "--db is required" << lineEnd;
+        return 1;
+    }
+    if (!openDatabase(parser.value("db")))
+    {
+        return 1;
+    }
+
+    QString command = args.takeFirst();
+    if (command == "balance")
+    {
+        return balance(parser);
+    }
+    else if (command == "rebuild-balances")
+    {
+        return rebuildBalances();
+    }
+    else if (command == "import")
+    {
+        return importCsv(parser, args);
+    }
+    else if (command == "export")
+    {
+        return exportLedger(parser);
+    }
+    else if (command == "report")
+    {
+        return report(parser);
+    }
+    else if (command == "rules")
+    {
+        return listRules();
+    }
+    else if (command == "add-rule")
+    {
+        return addRule(parser, args);
+    }
+    else if (command == "categorize")
+    {
+        return categorize();
+    }
+
+    err << "Unknown command: " << command << lineEnd;
+    return 1;
+}
+
+bool BatchCommands::openDatabase(const QString &path)
+{
+    QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE");
+    db.setDatabaseName(path);
+    if (!QFileInfo(path).isFile() || !db.open())
+    {
+        err << "Unable to open database " << path << lineEnd;
+        return false;
+    }
+    if (!TransactionsModel::createSchema())
+    {
+        err << "Unable to update the database schema: " << db.lastError().text() << lineEnd;
+        return false;
+    }
+
+    //batch jobs never undo, so the journal keeps nothing
+    transactions = new TransactionsModel();
+    transactions->setUndoLimit(0);
+    transactions->exchangeRates()->load();
+    rules.load();
+    return true;
+}
+
+/*
+ *  returns the pk_uid for an account given by pk_uid or by name, -1 if there is none
+ */
+int BatchCommands::resolveAccount(const QString &account)
+{
+    bool isId;
+    int accountId = account.toInt(&isId);
+
+    QSqlQuery q;
+    if (isId)
+    {
+        q.prepare("SELECT pk_uid FROM account WHERE pk_uid = ?");
+        q.addBindValue(accountId);
+    }
+    else
+    {
+        q.prepare("SELECT pk_uid FROM account WHERE account_name = ?");
+        q.addBindValue(account);
+    }
+    if (q.exec() && q.first())
+    {
+        return q.value(0).toInt();
+    }
+
+    err << "Unknown account: " << account << lineEnd;
+    return -1;
+}
+
+/*
+ *  prints the cached balance of one account or of every account
+ */
+int BatchCommands::balance(const QCommandLineParser &parser)
+{
+    QSqlQuery q;
+    q.setForwardOnly(true);
+    QString sql = "SELECT account.pk_uid, account.account_name, account.currency, COALESCE(account_balance.balance, 0) "
+                  "FROM account LEFT JOIN account_balance ON account.pk_uid = account_balance.id_account";
+    if (parser.isSet("account"))
+    {
+        int accountId = resolveAccount(parser.value("account"));
+        if (accountId < 0) return 1;
+        q.prepare(sql + " WHERE account.pk_uid = ?");
+        q.addBindValue(accountId);
+    }
+    else
+    {
+        q.prepare(sql + " ORDER BY account.account_name");
+    }
+    if (!q.exec())
+    {
+        err << q.lastError().text() << lineEnd;
+        return 1;
+    }
+
+    while (q.next())
+    {
+        out << q.value(0).toInt() << '\t' << q.value(1).toString() << '\t'
+            << q.value(2).toString() << '\t' << QString::number(q.value(3).toDouble(), 'f', 2) << '\n';
+    }
+    out.flush();
+    return 0;
+}
+
+int BatchCommands::rebuildBalances()
+{
+    if (!TransactionsModel::rebuildBalances() || !TransactionsModel::rebuildBudgets())
+    {
+        err << "Could not rebuild balances: " << QSqlDatabase::database().lastError().text() << lineEnd;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ *  imports "yyyy-MM-dd,comment,amount" lines into --account. rows are added in chunks
+ *  so memory stays bounded on large files
+ */
+int BatchCommands::importCsv(const QCommandLineParser &parser, const QStringList &args)
+{
+    if (args.isEmpty() || !parser.isSet("account"))
+    {
+        err << "usage: import <file.csv> --account <account>" << lineEnd;
+        return 1;
+    }
+    int accountId = resolveAccount(parser.value("account"));
+    if (accountId < 0) return 1;
+
+    QFile file(args.first());
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        err << "Could not open " << args.first() << ": " << file.errorString() << lineEnd;
+        return 1;
+    }
+
+    QTextStream in(&file);
+    QVector<JournalRow> chunk;
+    int moved = 0;
+    int lineNumber = 0;
+    int imported = 0;
+    while (!in.atEnd())
+    {
+        QString line = in.readLine();
+        ++lineNumber;
+        if (line.trimmed().isEmpty()) continue;
+
+        QStringList fields = parseCsvLine(line);
+        QDate date = QDate::fromString(fields.value(0).trimmed(), "yyyy-MM-dd");
+        bool amountOk;
+        double amount = fields.value(2).trimmed().toDouble(&amountOk);
+        if (fields.size() < 3 || !date.isValid() || !amountOk)
+        {
+            if (lineNumber == 1) continue;    //header
+            err << "Invalid transaction on line " << lineNumber << lineEnd;
+            return 1;
+        }
+
+        JournalRow row;
+        row.pk_uid = 0;
+        row.id_account = accountId;
+        row.date_trans = date.toJulianDay();
+        row.comment = fields.at(1);
+        row.amount = amount;
+        row.reconciled = 0;
+        chunk.append(row);
+
+        if (chunk.size() == importChunkSize && !importChunk(accountId, chunk, &imported, &moved))
+        {
+            err << "Import failed near line " << lineNumber << lineEnd;
+            return 1;
+        }
+    }
+    if (!importChunk(accountId, chunk, &imported, &moved))
+    {
+        err << "Import failed near line " << lineNumber << lineEnd;
+        return 1;
+    }
+
+    out << imported << " transactions imported, " << moved << " categorized by rules" << lineEnd;
+    return 0;
+}
+
+/*
+ *  streams transactions with running balances to --output (stdout by default) in csv,
+ *  json lines or the columnar format, optionally limited to --account and --from/--to
+ */
+int BatchCommands::exportLedger(const QCommandLineParser &parser)
+{
+    LedgerExporter exporter;
+    LedgerExporter::Format format = LedgerExporter::Csv;
+
+    if (parser.isSet("format") && !LedgerExporter::formatFromName(parser.value("format"), &format))
+    {
+        err << "Unknown format: " << parser.value("format") << lineEnd;
+        return 1;
+    }
+    if (parser.isSet("account"))
+    {
+        int accountId = resolveAccount(parser.value("account"));
+        if (accountId < 0) return 1;
+        exporter.setAccount(accountId);
+    }
+    QDate from = QDate::fromString(parser.value("from"), "yyyy-MM-dd");
+    QDate to = QDate::fromString(parser.value("to"), "yyyy-MM-dd");
+    if ((parser.isSet("from") && !from.isValid()) || (parser.isSet("to") && !to.isValid()))
+    {
+        err << "Dates must be given as yyyy-MM-dd" << lineEnd;
+        return 1;
+    }
+    exporter.setDateRange(from, to);
+
+    QFile file;
+    bool opened;
+    if (parser.isSet("output"))
+    {
+        file.setFileName(parser.value("output"));
+        opened = file.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    }
+    else
+    {
+        out.flush();
+        opened = file.open(stdout, QIODevice::WriteOnly);
+    }
+    if (!opened)
+    {
+        err << "Could not open output: " << file.errorString() << lineEnd;
+        return 1;
+    }
+
+    if (!exporter.write(&file, format))
+    {
+        err << "Export failed: " << exporter.errorString() << lineEnd;
+        return 1;
+    }
+    file.close();
+    err << exporter.rowCount() << " transactions exported" << lineEnd;
+    return 0;
+}
+
+/*
+ *  monthly inflow, outflow and net per account. split lines count against their own
+ *  account in their parent's month, as they do in the balance cache
+ */
+int BatchCommands::report(const QCommandLineParser &parser)
+{
+    QSqlQuery q;
+    q.setForwardOnly(true);
+    QString sql = "SELECT account.account_name, strftime('%Y-%m', trans.date_trans) AS month, "
+                  "SUM(CASE WHEN trans.amount > 0 THEN trans.amount ELSE 0 END), "
+                  "SUM(CASE WHEN trans.amount < 0 THEN trans.amount ELSE 0 END), "
+                  "SUM(trans.amount) "
+                  "FROM (SELECT id_account, date_trans, amount FROM trans "
+                  "UNION ALL SELECT s.id_account, t.date_trans, -s.amount FROM trans_split s JOIN trans t ON t.pk_uid = s.id_trans) trans "
+                  "JOIN account ON trans.id_account = account.pk_uid ";
+    if (parser.isSet("account"))
+    {
+        int accountId = resolveAccount(parser.value("account"));
+        if (accountId < 0) return 1;
+        q.prepare(sql + "WHERE trans.id_account = ? GROUP BY account.account_name, month ORDER BY account.account_name, month");
+        q.addBindValue(accountId);
+    }
+    else
+    {
+        q.prepare(sql + "GROUP BY account.account_name, month ORDER BY account.account_name, month");
+    }
+    if (!q.exec())
+    {
+        err << q.lastError().text() << lineEnd;
+        return 1;
+    }
+
+    out << "account\tmonth\tin\tout\tnet\n";
+    while (q.next())
+    {
+        out << q.value(0).toString() << '\t' << q.value(1).toString() << '\t'
+            << QString::number(q.value(2).toDouble(), 'f', 2) << '\t'
+            << QString::number(q.value(3).toDouble(), 'f', 2) << '\t'
+            << QString::number(q.value(4).toDouble(), 'f', 2) << '\n';
+    }
+    out.flush();
+    return 0;
+}
+
+/*
+ *  adds one chunk of imported rows and runs the rules over just those rows. both happen in
+ *  one bulk operation, so a chunk is either fully imported and categorized or not at all
+ */
+bool BatchCommands::importChunk(int accountId, QVector<JournalRow> &chunk, int *imported, int *moved)
+{
+    QList<int> ids;
+    int chunkMoved = 0;
+    transactions->beginBulk("Import transactions");
+    bool success = transactions->importTransactions(accountId, chunk, &ids)
+            && transactions->categorize(rules, ids, &chunkMoved);
+    if (!transactions->endBulk() || !success)
+    {
+        return false;
+    }
+    *imported += chunk.size();
+    *moved += chunkMoved;
+    chunk.clear();
+    return true;
+}
+
+/*
+ *  lists the categorization rules in priority order
+ */
+int BatchCommands::listRules()
+{
+    QSqlQuery q;
+    q.setForwardOnly(true);
+    if (!q.exec("SELECT rule.pk_uid, rule.pattern, rule.amount_min, rule.amount_max, account.account_name "
+                "FROM rule LEFT JOIN account ON rule.id_account = account.pk_uid ORDER BY rule.pk_uid"))
+    {
+        err << q.lastError().text() << lineEnd;
+        return 1;
+    }
+
+    out << "pk_uid\tpattern\tmin\tmax\taccount\n";
+    while (q.next())
+    {
+        out << q.value(0).toInt() << '\t' << q.value(1).toString() << '\t'
+            << q.value(2).toString() << '\t' << q.value(3).toString() << '\t'
+            << q.value(4).toString() << '\n';
+    }
+    out.flush();
+    return 0;
+}
+
+/*
+ *  adds a rule sending comments containing <pattern> to --account, optionally within --min/--max
+ */
+int BatchCommands::addRule(const QCommandLineParser &parser, const QStringList &args)
+{
+    if (args.isEmpty() || !parser.isSet("account"))
+    {
+        err << "usage: add-rule <pattern> --account <account> [--min amount] [--max amount]" << lineEnd;
+        return 1;
+    }
+    int accountId = resolveAccount(parser.value("account"));
+    if (accountId < 0) return 1;
+
+    QSqlQuery q;
+    q.prepare("INSERT INTO rule (pattern, amount_min, amount_max, id_account) VALUES (?,?,?,?)");
+    q.addBindValue(args.first());
+    q.addBindValue(parser.isSet("min") ? QVariant(parser.value("min").toDouble()) : QVariant(QVariant::Double));
+    q.addBindValue(parser.isSet("max") ? QVariant(parser.value("max").toDouble()) : QVariant(QVariant::Double));
+    q.addBindValue(accountId);
+    if (!q.exec())
+    {
+        err << q.lastError().text() << lineEnd;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ *  runs the rules over the whole ledger
+ */
+int BatchCommands::categorize()
+{
+    int moved;
+    if (!transactions->categorizeAll(rules, &moved))
+    {
+        err << "Categorizing failed: " << QSqlDatabase::database().lastError().text() << lineEnd;
+        return 1;
+    }
+    out << moved << " transactions categorized" << lineEnd;
+    return 0;
+}
+
+/*
+ *  splits one csv line, honouring double-quoted fields
+ */
+QStringList BatchCommands::parseCsvLine(const QString &line)
+{
+    QStringList fields;
+    QString field;
+    bool quoted = false;
+    for (int i = 0; i < line.length(); ++i)
+    {
+        QChar c = line.at(i);
+        if (quoted)
+        {
+            if (c == '"' && i + 1 < line.length() && line.at(i + 1) == '"')
+            {
+                field.append('"');
+                ++i;
+            }
+            else if (c == '"')
+            {
+                quoted = false;
+            }
+            else
+            {
+                field.append(c);
+            }
+        }
+        else if (c == '"')
+        {
+            quoted = true;
+        }
+        else if (c == ',')
+        {
+            fields.append(field);
+            field.clear();
+        }
+        else
+        {
+            field.append(c);
+        }
+    }
+    fields.append(field);
+    return fields;
+}
@@ -0,0 +1,40 @@
+#ifndef BATCHCOMMANDS_H
+#define BATCHCOMMANDS_H
+
+#include <QCommandLineParser>
+#include <QStringList>
+#include <QTextStream>
+#include "transactionsmodel.h"
+
+/*
+ *  the commands of the headless coin-cli tool. every command works on the
+ *  same data layer as the gui and writes its results to stdout
+ */
+class BatchCommands
+{
+public:
+    BatchCommands();
+    ~BatchCommands();
+    static void addOptions(QCommandLineParser &parser);
+    int run(const QCommandLineParser &parser);
+
+private:
+    QTextStream out;
+    QTextStream err;
+    TransactionsModel *transactions;
+    RuleMatcher rules;
+    bool openDatabase(const QString &path);
+    int resolveAccount(const QString &account);
+    int balance(const QCommandLineParser &parser);
+    int rebuildBalances();
+    int importCsv(const QCommandLineParser &parser, const QStringList &args);
+    bool importChunk(int accountId, QVector<JournalRow> &chunk, int *imported, int *moved);
+    int exportLedger(const QCommandLineParser &parser);
+    int report(const QCommandLineParser &parser);
+    int listRules();
+    int addRule(const QCommandLineParser &parser, const QStringList &args);
+    int categorize();
+    static QStringList parseCsvLine(const QString &line);
+};
+
+#endif // BATCHCOMMANDS_H
@@ -0,0 +1,19 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include "batchcommands.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("coin-cli");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless batch mode for coin databases.");
+    parser.addHelpOption();
+    BatchCommands::addOptions(parser);
+    parser.process(a);
+
+    //commands run to completion without an event loop
+    BatchCommands commands;
+    return commands.run(parser);
+}
@@ -0,0 +1,30 @@
+#-------------------------------------------------
+#
+# Headless batch tool sharing the coin data layer
+#
+#-------------------------------------------------
+
+QT       += core sql
+QT       -= gui
+
+TARGET = coin-cli
+CONFIG   += console
+CONFIG   -= app_bundle
+TEMPLATE = app
+
+
+SOURCES += climain.cpp \
+    batchcommands.cpp \
+    transactionsmodel.cpp \
+    undojournal.cpp \
+    exchangerates.cpp \
+    ledgerexporter.cpp \
+    rulematcher.cpp
+
+HEADERS  += batchcommands.h \
+    transactionsmodel.h \
+    undojournal.h \
+    exchangerates.h \
+    ledgerexporter.h \
+    rulematcher.h \
+    definitions.h
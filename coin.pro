@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui sql
+QT       += core gui sql concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -15,12 +15,33 @@ TEMPLATE = app
 SOURCES += main.cpp\
         mainwindow.cpp \
     transactionsmodel.cpp \
-    dialognewaccount.cpp
+    dialognewaccount.cpp \
+    undojournal.cpp \
+    exchangerates.cpp \
+    dialogsplits.cpp \
+    ledgerexporter.cpp \
+    rulematcher.cpp \
+    payeeindex.cpp \
+    dialogbudgets.cpp \
+    ledgerscanner.cpp \
+    dialogreview.cpp
 
 HEADERS  += mainwindow.h \
     transactionsmodel.h \
     dialognewaccount.h \
-    definitions.h
+    definitions.h \
+    undojournal.h \
+    exchangerates.h \
+    dialogsplits.h \
+    ledgerexporter.h \
+    rulematcher.h \
+    payeeindex.h \
+    dialogbudgets.h \
+    ledgerscanner.h \
+    dialogreview.h
 
 FORMS    += mainwindow.ui \
-    dialognewaccount.ui
+    dialognewaccount.ui \
+    dialogsplits.ui \
+    dialogbudgets.ui \
+    dialogreview.ui
@@ -9,5 +9,22 @@
 #define col_amount 5
 #define col_total 6
 #define col_reconciled 7
+#define col_currency 8
+#define col_count 9
+
+#define transactionPageRows 256    //rows read per keyset page of the transactions table
+#define payeeLookupRows 10    //comments offered by the autocomplete, and kept per prefix in its index
+
+#define dateRangeAll 0
+#define dateRange30Days 1
+#define dateRange90Days 2
+#define dateRange365Days 3
+#define dateRangeYearToDate 4
+#define dateRangeCustom 5
+
+#define baseCurrency "USD"
+
+//#define pathDB "/shared/coin/coin.db"
+#define pathDB "/home/spencer/dev/coin/coin/coin.db"
 
 #endif // DEFINITIONS_H
@@ -0,0 +1,204 @@
+#include "dialogbudgets.h"
+#include "ui_dialogbudgets.h"
+#include "transactionsmodel.h"
+#include "definitions.h"
+#include <QInputDialog>
+#include <QMessageBox>
+#include <QProgressBar>
+#include <QtSql>
+
+#define budget_col_account 0
+#define budget_col_planned 1
+#define budget_col_spent 2
+#define budget_col_remaining 3
+#define budget_col_progress 4
+
+DialogBudgets::DialogBudgets(QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::DialogBudgets)
+{
+    ui->setupUi(this);
+    ui->tableBudgets->horizontalHeader()->setSectionResizeMode(budget_col_account,QHeaderView::Stretch);
+    ui->tableBudgets->horizontalHeader()->setSectionResizeMode(budget_col_progress,QHeaderView::Stretch);
+
+    QDate today = QDate::currentDate();
+    month = QDate(today.year(),today.month(),1);
+    connect(ui->tableBudgets,SIGNAL(cellChanged(int,int)),this,SLOT(plannedChanged(int,int)));
+    loadBudgets();
+}
+
+DialogBudgets::~DialogBudgets()
+{
+    delete ui;
+}
+
+void DialogBudgets::on_btnPreviousMonth_clicked()
+{
+    month = month.addMonths(-1);
+    loadBudgets();
+}
+
+void DialogBudgets::on_btnNextMonth_clicked()
+{
+    month = month.addMonths(1);
+    loadBudgets();
+}
+
+/*
+ *  adds a budget for an account and everything below it. its past months are
+ *  worked out once here, after that the ledger mutators keep them current
+ */
+void DialogBudgets::on_btnAddBudget_clicked()
+{
+    QStringList names;
+    QList<int> ids;
+    QSqlQuery q;
+    q.exec("SELECT pk_uid, account_name FROM account WHERE pk_uid NOT IN (SELECT id_account FROM budget) ORDER BY account_name");
+    while (q.next())
+    {
+        ids.append(q.value(0).toInt());
+        names.append(q.value(1).toString());
+    }
+    if (names.isEmpty())
+    {
+        return;
+    }
+
+    bool ok;
+    QString name = QInputDialog::getItem(this, tr("Add budget"), tr("Account (includes its sub-accounts):"), names, 0, false, &ok);
+    if (!ok)
+    {
+        return;
+    }
+    double planned = QInputDialog::getDouble(this, tr("Add budget"), tr("Planned per month:"), 0, -1e9, 1e9, 2, &ok);
+    if (!ok)
+    {
+        return;
+    }
+
+    q.prepare("INSERT INTO budget (id_account, planned) VALUES (?,?)");
+    q.addBindValue(ids.at(names.indexOf(name)));
+    q.addBindValue(planned);
+    if (!q.exec() || !TransactionsModel::rebuildBudgets(q.lastInsertId().toInt()))
+    {
+        QMessageBox::critical(this, tr("Add budget"), tr("Could not add the budget."));
+    }
+    loadBudgets();
+}
+
+void DialogBudgets::on_btnRemoveBudget_clicked()
+{
+    int row = ui->tableBudgets->currentRow();
+    if (row < 0)
+    {
+        return;
+    }
+    int budgetId = ui->tableBudgets->item(row,budget_col_account)->data(Qt::UserRole).toInt();
+
+    QSqlDatabase db = QSqlDatabase::database();
+    QSqlQuery q;
+    db.transaction();
+    q.prepare("DELETE FROM budget_month WHERE id_budget = ?");
+    q.addBindValue(budgetId);
+    bool success = q.exec();
+    q.prepare("DELETE FROM budget WHERE pk_uid = ?");
+    q.addBindValue(budgetId);
+    success = success && q.exec();
+    if (!success || !db.commit())
+    {
+        db.rollback();
+        QMessageBox::critical(this, tr("Remove budget"), tr("Could not remove the budget."));
+    }
+    loadBudgets();
+}
+
+/*
+ *  saves an edited planned amount
+ */
+void DialogBudgets::plannedChanged(int row, int column)
+{
+    if (column != budget_col_planned)
+    {
+        return;
+    }
+    double planned = ui->tableBudgets->item(row,column)->text().toDouble();
+    QSqlQuery q;
+    q.prepare("UPDATE budget SET planned = ? WHERE pk_uid = ?");
+    q.addBindValue(planned);
+    q.addBindValue(ui->tableBudgets->item(row,budget_col_account)->data(Qt::UserRole));
+    q.exec();
+
+    ui->tableBudgets->blockSignals(true);
+    showProgress(row,planned);
+    ui->tableBudgets->blockSignals(false);
+}
+
+/*
+ *  fills the remaining and progress cells of a line from its planned and spent amounts
+ */
+void DialogBudgets::showProgress(int row, double planned)
+{
+    double spent = ui->tableBudgets->item(row,budget_col_spent)->data(Qt::UserRole).toDouble();
+    QString currency = ui->tableBudgets->item(row,budget_col_remaining)->data(Qt::UserRole).toString();
+    QTableWidgetItem *remainingItem = ui->tableBudgets->item(row,budget_col_remaining);
+    remainingItem->setText(ExchangeRates::formatAmount(planned - spent,currency));
+    remainingItem->setForeground(spent > planned ? QBrush(Qt::red) : QBrush());
+
+    QProgressBar *progress = qobject_cast<QProgressBar*>(ui->tableBudgets->cellWidget(row,budget_col_progress));
+    progress->setValue(planned > 0 ? qBound(0,qRound(100 * spent / planned),100) : 0);
+}
+
+/*
+ *  one line per budget for the shown month. the spent amount is a primary key lookup in
+ *  budget_month, so the dashboard costs the same however large the ledger gets
+ */
+void DialogBudgets::loadBudgets()
+{
+    ui->lblMonth->setText(month.toString("MMMM yyyy"));
+    ui->tableBudgets->blockSignals(true);
+    ui->tableBudgets->setRowCount(0);
+
+    QSqlQuery q;
+    q.setForwardOnly(true);
+    q.prepare("SELECT budget.pk_uid, account.account_name, COALESCE(account.currency, '" baseCurrency "'), budget.planned, "
+              "COALESCE(budget_month.spent, 0) "
+              "FROM budget JOIN account ON account.pk_uid = budget.id_account "
+              "LEFT JOIN budget_month ON budget_month.id_budget = budget.pk_uid AND budget_month.month = ? "
+              "ORDER BY account.account_name");
+    q.addBindValue(month.year() * 100 + month.month());
+    q.exec();
+    while (q.next())
+    {
+        int row = ui->tableBudgets->rowCount();
+        QString currency = q.value(2).toString();
+        double planned = q.value(3).toDouble();
+        double spent = q.value(4).toDouble();
+        ui->tableBudgets->insertRow(row);
+
+        QTableWidgetItem *accountItem = new QTableWidgetItem(q.value(1).toString());
+        accountItem->setData(Qt::UserRole,q.value(0));
+        accountItem->setFlags(accountItem->flags() & ~Qt::ItemIsEditable);
+        ui->tableBudgets->setItem(row,budget_col_account,accountItem);
+
+        ui->tableBudgets->setItem(row,budget_col_planned,new QTableWidgetItem(QString::number(planned,'f',2)));
+
+        QTableWidgetItem *spentItem = new QTableWidgetItem(ExchangeRates::formatAmount(spent,currency));
+        spentItem->setData(Qt::UserRole,spent);
+        spentItem->setFlags(spentItem->flags() & ~Qt::ItemIsEditable);
+        spentItem->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+        ui->tableBudgets->setItem(row,budget_col_spent,spentItem);
+
+        QTableWidgetItem *remainingItem = new QTableWidgetItem();
+        remainingItem->setData(Qt::UserRole,currency);
+        remainingItem->setFlags(remainingItem->flags() & ~Qt::ItemIsEditable);
+        remainingItem->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+        ui->tableBudgets->setItem(row,budget_col_remaining,remainingItem);
+
+        QProgressBar *progress = new QProgressBar(ui->tableBudgets);
+        progress->setRange(0,100);
+        ui->tableBudgets->setCellWidget(row,budget_col_progress,progress);
+        showProgress(row,planned);
+    }
+
+    ui->tableBudgets->blockSignals(false);
+}
@@ -0,0 +1,33 @@
+#ifndef DIALOGBUDGETS_H
+#define DIALOGBUDGETS_H
+
+#include <QDate>
+#include <QDialog>
+
+namespace Ui {
+class DialogBudgets;
+}
+
+class DialogBudgets : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit DialogBudgets(QWidget *parent = 0);
+    ~DialogBudgets();
+
+private slots:
+    void on_btnPreviousMonth_clicked();
+    void on_btnNextMonth_clicked();
+    void on_btnAddBudget_clicked();
+    void on_btnRemoveBudget_clicked();
+    void plannedChanged(int row, int column);
+
+private:
+    Ui::DialogBudgets *ui;
+    QDate month;    //first day of the month shown
+    void loadBudgets();
+    void showProgress(int row, double planned);
+};
+
+#endif // DIALOGBUDGETS_H
@@ -0,0 +1,100 @@
+#include "dialogreview.h"
+#include "ui_dialogreview.h"
+#include "transactionsmodel.h"
+#include <QMessageBox>
+#include <QtSql>
+
+#define review_col_issue 0
+#define review_col_date 1
+#define review_col_account 2
+#define review_col_comment 3
+#define review_col_amount 4
+
+DialogReview::DialogReview(LedgerScanner *scanner, TransactionsModel *model, QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::DialogReview),
+    scanner(scanner),
+    model(model)
+{
+    ui->setupUi(this);
+    ui->tableFindings->horizontalHeader()->setSectionResizeMode(review_col_comment,QHeaderView::Stretch);
+    on_btnRescan_clicked();
+}
+
+DialogReview::~DialogReview()
+{
+    delete ui;
+}
+
+/*
+ *  picks up whatever changed since the last scan
+ */
+void DialogReview::on_btnRescan_clicked()
+{
+    if (!scanner->scan())
+    {
+        QMessageBox::critical(this, tr("Review ledger"), tr("Could not scan the ledger."));
+    }
+    loadFindings();
+}
+
+/*
+ *  fixes every checked finding in one batch, which is a single undo step
+ */
+void DialogReview::on_btnFix_clicked()
+{
+    QList<Finding> selected;
+    for (int row = 0; row < ui->tableFindings->rowCount(); ++row)
+    {
+        if (ui->tableFindings->item(row,review_col_issue)->checkState() == Qt::Checked)
+        {
+            selected.append(shown.at(row));
+        }
+    }
+    if (selected.isEmpty())
+    {
+        return;
+    }
+
+    if (!scanner->fix(model, selected))
+    {
+        QMessageBox::critical(this, tr("Review ledger"), tr("Could not apply the fixes. Nothing was changed."));
+    }
+    on_btnRescan_clicked();
+}
+
+void DialogReview::loadFindings()
+{
+    QHash<int,QString> accountNames;
+    QHash<int,QString> currencies;
+    QSqlQuery q;
+    q.exec("SELECT pk_uid, account_name, currency FROM account");
+    while (q.next())
+    {
+        accountNames.insert(q.value(0).toInt(), q.value(1).toString());
+        currencies.insert(q.value(0).toInt(), q.value(2).toString());
+    }
+
+    shown = scanner->findings();
+    ui->tableFindings->setRowCount(0);
+    for (int i = 0; i < shown.size(); ++i)
+    {
+        const Finding &f = shown.at(i);
+        int row = ui->tableFindings->rowCount();
+        ui->tableFindings->insertRow(row);
+
+        QTableWidgetItem *issueItem = new QTableWidgetItem(LedgerScanner::describe(f));
+        issueItem->setFlags(Qt::ItemIsEnabled | Qt::ItemIsUserCheckable);
+        issueItem->setCheckState(Qt::Checked);
+        ui->tableFindings->setItem(row,review_col_issue,issueItem);
+        ui->tableFindings->setItem(row,review_col_date,new QTableWidgetItem(f.date.toString("yyyy-MM-dd")));
+        ui->tableFindings->setItem(row,review_col_account,new QTableWidgetItem(accountNames.value(f.id_account)));
+        ui->tableFindings->setItem(row,review_col_comment,new QTableWidgetItem(f.comment));
+        QTableWidgetItem *amountItem = new QTableWidgetItem(ExchangeRates::formatAmount(f.amount,currencies.value(f.id_account)));
+        amountItem->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+        ui->tableFindings->setItem(row,review_col_amount,amountItem);
+    }
+
+    ui->lblSummary->setText(tr("%1 findings").arg(shown.size()));
+    ui->btnFix->setEnabled(!shown.isEmpty());
+}
@@ -0,0 +1,34 @@
+#ifndef DIALOGREVIEW_H
+#define DIALOGREVIEW_H
+
+#include <QDialog>
+#include <QList>
+#include "ledgerscanner.h"
+
+class TransactionsModel;
+
+namespace Ui {
+class DialogReview;
+}
+
+class DialogReview : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit DialogReview(LedgerScanner *scanner, TransactionsModel *model, QWidget *parent = 0);
+    ~DialogReview();
+
+private slots:
+    void on_btnRescan_clicked();
+    void on_btnFix_clicked();
+
+private:
+    Ui::DialogReview *ui;
+    LedgerScanner *scanner;
+    TransactionsModel *model;
+    QList<Finding> shown;
+    void loadFindings();
+};
+
+#endif // DIALOGREVIEW_H
@@ -0,0 +1,117 @@
+#include "dialogsplits.h"
+#include "ui_dialogsplits.h"
+#include "exchangerates.h"
+#include <QComboBox>
+#include <QtSql>
+
+#define split_col_account 0
+#define split_col_comment 1
+#define split_col_amount 2
+
+DialogSplits::DialogSplits(const QVector<SplitLine> &lines, const QString &currency, QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::DialogSplits),
+    currency(currency)
+{
+    ui->setupUi(this);
+    ui->tableSplits->horizontalHeader()->setSectionResizeMode(split_col_comment,QHeaderView::Stretch);
+
+    for (int i = 0; i < lines.size(); ++i)
+    {
+        addLine(lines.at(i));
+    }
+    connect(ui->tableSplits,SIGNAL(cellChanged(int,int)),this,SLOT(updateTotal()));
+    updateTotal();
+}
+
+DialogSplits::~DialogSplits()
+{
+    delete ui;
+}
+
+/*
+ *  returns the lines as entered. lines that already existed keep their pk_uid
+ */
+QVector<SplitLine> DialogSplits::lines() const
+{
+    QVector<SplitLine> result;
+    for (int row = 0; row < ui->tableSplits->rowCount(); ++row)
+    {
+        QComboBox *combo = qobject_cast<QComboBox*>(ui->tableSplits->cellWidget(row,split_col_account));
+        QTableWidgetItem *commentItem = ui->tableSplits->item(row,split_col_comment);
+        QTableWidgetItem *amountItem = ui->tableSplits->item(row,split_col_amount);
+
+        SplitLine line;
+        line.pk_uid = commentItem->data(Qt::UserRole).toInt();
+        line.id_trans = 0;
+        line.id_account = combo->itemData(combo->currentIndex()).toInt();
+        line.comment = commentItem->text();
+        line.amount = amountItem->text().toDouble();
+        result.append(line);
+    }
+    return result;
+}
+
+void DialogSplits::on_btnAddLine_clicked()
+{
+    SplitLine line;
+    line.pk_uid = 0;
+    line.id_trans = 0;
+    line.id_account = 0;
+    line.amount = 0;
+    addLine(line);
+}
+
+void DialogSplits::on_btnRemoveLine_clicked()
+{
+    int row = ui->tableSplits->currentRow();
+    if (row >= 0)
+    {
+        ui->tableSplits->removeRow(row);
+        updateTotal();
+    }
+}
+
+/*
+ *  shows the sum of the lines, which becomes the amount of the transaction
+ */
+void DialogSplits::updateTotal()
+{
+    double total = 0;
+    for (int row = 0; row < ui->tableSplits->rowCount(); ++row)
+    {
+        QTableWidgetItem *amountItem = ui->tableSplits->item(row,split_col_amount);
+        if (amountItem)
+        {
+            total += amountItem->text().toDouble();
+        }
+    }
+    ui->lblTotal->setText(tr("Total: ") + ExchangeRates::formatAmount(total,currency));
+}
+
+/*
+ *  appends a row with an account combobox filled from the account table
+ */
+void DialogSplits::addLine(const SplitLine &line)
+{
+    int row = ui->tableSplits->rowCount();
+    ui->tableSplits->blockSignals(true);
+    ui->tableSplits->insertRow(row);
+
+    QComboBox *combo = new QComboBox(ui->tableSplits);
+    QSqlQuery q;
+    q.exec("SELECT pk_uid, account_name FROM account ORDER BY account_name");
+    while (q.next())
+    {
+        combo->addItem(q.value(1).toString(),q.value(0));
+    }
+    combo->setCurrentIndex(qMax(0,combo->findData(line.id_account)));
+    ui->tableSplits->setCellWidget(row,split_col_account,combo);
+
+    QTableWidgetItem *commentItem = new QTableWidgetItem(line.comment);
+    commentItem->setData(Qt::UserRole,line.pk_uid);
+    ui->tableSplits->setItem(row,split_col_comment,commentItem);
+    ui->tableSplits->setItem(row,split_col_amount,new QTableWidgetItem(QString::number(line.amount,'f',2)));
+
+    ui->tableSplits->blockSignals(false);
+}
@@ -0,0 +1,32 @@
+#ifndef DIALOGSPLITS_H
+#define DIALOGSPLITS_H
+
+#include <QDialog>
+#include <QVector>
+#include "undojournal.h"
+
+namespace Ui {
+class DialogSplits;
+}
+
+class DialogSplits : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit DialogSplits(const QVector<SplitLine> &lines, const QString &currency, QWidget *parent = 0);
+    ~DialogSplits();
+    QVector<SplitLine> lines() const;
+
+private slots:
+    void on_btnAddLine_clicked();
+    void on_btnRemoveLine_clicked();
+    void updateTotal();
+
+private:
+    Ui::DialogSplits *ui;
+    QString currency;
+    void addLine(const SplitLine &line);
+};
+
+#endif // DIALOGSPLITS_H
@@ -0,0 +1,149 @@
+#include <QtSql>
+#include <QFile>
+#include <QLocale>
+#include <QTextStream>
+#include "exchangerates.h"
+#include "definitions.h"
+
+ExchangeRates::ExchangeRates()
+{
+}
+
+/*
+ *  reads the whole exchange_rate table into memory. called once at startup and after imports
+ */
+bool ExchangeRates::load()
+{
+    QSqlQuery q;
+    q.setForwardOnly(true);
+    if (!q.exec("SELECT currency, date_rate, rate FROM exchange_rate")) return false;
+
+    rates.clear();
+    while (q.next())
+    {
+        QDate d = QDate::fromString(q.value(1).toString(), "yyyy-MM-dd");
+        rates[q.value(0).toString()].insert(d.toJulianDay(), q.value(2).toDouble());
+    }
+    return true;
+}
+
+/*
+ *  loads rates from a local file with one "currency,yyyy-MM-dd,rate" line per rate.
+ *  blank lines, comments (#) and a header line are skipped
+ */
+bool ExchangeRates::importFile(const QString &path, QString *errorMessage)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
+    {
+        if (errorMessage) *errorMessage = file.errorString();
+        return false;
+    }
+
+    QVariantList currency, dateRate, rate;
+    QTextStream in(&file);
+    int lineNumber = 0;
+    while (!in.atEnd())
+    {
+        QString line = in.readLine().trimmed();
+        ++lineNumber;
+        if (line.isEmpty() || line.startsWith('#')) continue;
+
+        QStringList fields = line.split(',');
+        bool ok = fields.size() == 3;
+        double r = ok ? fields.at(2).trimmed().toDouble(&ok) : 0;
+        QDate d = QDate::fromString(fields.value(1).trimmed(), "yyyy-MM-dd");
+        if (!ok || !d.isValid() || r <= 0)
+        {
+            if (lineNumber == 1) continue;    //header
+            if (errorMessage) *errorMessage = QObject::tr("Invalid rate on line %1").arg(lineNumber);
+            return false;
+        }
+        currency << fields.at(0).trimmed().toUpper();
+        dateRate << d.toString("yyyy-MM-dd");
+        rate << r;
+    }
+
+    QSqlDatabase db = QSqlDatabase::database();
+    QSqlQuery q;
+    db.transaction();
+    q.prepare("INSERT OR REPLACE INTO exchange_rate (currency, date_rate, rate) VALUES (?,?,?)");
+    q.addBindValue(currency);
+    q.addBindValue(dateRate);
+    q.addBindValue(rate);
+    if (!q.execBatch() || !db.commit())
+    {
+        if (errorMessage) *errorMessage = q.lastError().text();
+        db.rollback();
+        return false;
+    }
+    return load();
+}
+
+/*
+ *  returns the most recent rate on or before date. the base currency is always 1
+ */
+double ExchangeRates::rate(const QString &currency, const QDate &date, bool *ok) const
+{
+    if (ok) *ok = true;
+    if (currency.isEmpty() || currency == baseCurrency) return 1.0;
+
+    QHash<QString, QMap<qint64,double> >::const_iterator c = rates.constFind(currency);
+    if (c != rates.constEnd() && !c->isEmpty())
+    {
+        QMap<qint64,double>::const_iterator i = c->upperBound(date.toJulianDay());
+        if (i != c->constBegin())
+        {
+            return (--i).value();
+        }
+        return c->constBegin().value();    //date precedes every known rate: use the earliest one
+    }
+
+    if (ok) *ok = false;
+    return 1.0;
+}
+
+double ExchangeRates::convert(double amount, const QString &fromCurrency, const QString &toCurrency, const QDate &date, bool *ok) const
+{
+    if (fromCurrency == toCurrency)
+    {
+        if (ok) *ok = true;
+        return amount;
+    }
+
+    bool fromOk, toOk;
+    double converted = amount * rate(fromCurrency, date, &fromOk) / rate(toCurrency, date, &toOk);
+    if (ok) *ok = fromOk && toOk;
+    return converted;
+}
+
+/*
+ *  formats an amount with the symbol of the given ISO currency code
+ */
+QString ExchangeRates::formatAmount(double amount, const QString &currency)
+{
+    static QHash<QString,QString> symbols;
+    QLocale us(QLocale::English,QLocale::UnitedStates);
+
+    if (currency.isEmpty() || currency == baseCurrency)
+    {
+        return us.toCurrencyString(amount,us.currencySymbol());
+    }
+
+    //build the iso code -> symbol table once from the locales Qt knows about
+    if (symbols.isEmpty())
+    {
+        QList<QLocale> locales = QLocale::matchingLocales(QLocale::AnyLanguage,QLocale::AnyScript,QLocale::AnyCountry);
+        for (int i = 0; i < locales.size(); ++i)
+        {
+            QString code = locales.at(i).currencySymbol(QLocale::CurrencyIsoCode);
+            if (!code.isEmpty() && !symbols.contains(code))
+            {
+                symbols.insert(code, locales.at(i).currencySymbol(QLocale::CurrencySymbol));
+            }
+        }
+    }
+
+    QString symbol = symbols.value(currency, currency + " ");
+    return us.toCurrencyString(amount,symbol);
+}
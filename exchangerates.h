@@ -0,0 +1,27 @@
+#ifndef EXCHANGERATES_H
+#define EXCHANGERATES_H
+
+#include <QDate>
+#include <QHash>
+#include <QMap>
+#include <QString>
+
+/*
+ *  in-memory cache of the exchange_rate table. rates are units of the base
+ *  currency per unit of the given currency, looked up by (currency, date)
+ */
+class ExchangeRates
+{
+public:
+    ExchangeRates();
+    bool load();
+    bool importFile(const QString &path, QString *errorMessage = 0);
+    double rate(const QString &currency, const QDate &date, bool *ok = 0) const;
+    double convert(double amount, const QString &fromCurrency, const QString &toCurrency, const QDate &date, bool *ok = 0) const;
+    static QString formatAmount(double amount, const QString &currency);
+
+private:
+    QHash<QString, QMap<qint64,double> > rates;    //currency -> (julian day -> rate)
+};
+
+#endif // EXCHANGERATES_H
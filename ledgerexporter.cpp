@@ -0,0 +1,317 @@
+#include <QtSql>
+#include <QDataStream>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include "ledgerexporter.h"
+
+#define exportRowGroupSize 65536
+
+#define export_pk_uid 0
+#define export_id_account 1
+#define export_account 2
+#define export_currency 3
+#define export_date 4
+#define export_comment 5
+#define export_amount 6
+#define export_reconciled 7
+
+//the ledger as the account balances count it: trans rows plus every split line as a negated
+//row of its own account, dated by its parent and keyed by its negative pk_uid
+#define exportLedger "(SELECT pk_uid, id_account, date_trans, comment, amount, reconciled FROM trans " \
+                     "UNION ALL SELECT -s.pk_uid, s.id_account, p.date_trans, COALESCE(NULLIF(s.comment, ''), p.comment), -s.amount, p.reconciled " \
+                     "FROM trans_split s JOIN trans p ON p.pk_uid = s.id_trans) trans"
+
+static void writeInts(QDataStream &out, const QVector<qint64> &values)
+{
+    for (int i = 0; i < values.size(); ++i)
+    {
+        out << values.at(i);
+    }
+}
+
+static void writeDoubles(QDataStream &out, const QVector<double> &values)
+{
+    for (int i = 0; i < values.size(); ++i)
+    {
+        out << values.at(i);
+    }
+}
+
+static void writeStrings(QDataStream &out, const QList<QByteArray> &values)
+{
+    for (int i = 0; i < values.size(); ++i)
+    {
+        out << quint32(values.at(i).size());
+        out.writeRawData(values.at(i).constData(), values.at(i).size());
+    }
+}
+
+LedgerExporter::LedgerExporter() :
+    accountId(-1),
+    rows(0)
+{
+}
+
+/*
+ *  limits the export to one account. -1 exports every account
+ */
+void LedgerExporter::setAccount(int accountId)
+{
+    this->accountId = accountId;
+}
+
+/*
+ *  limits the export to a date range. an invalid date leaves that end open
+ */
+void LedgerExporter::setDateRange(const QDate &from, const QDate &to)
+{
+    fromDate = from;
+    toDate = to;
+}
+
+qint64 LedgerExporter::rowCount() const
+{
+    return rows;
+}
+
+QString LedgerExporter::errorString() const
+{
+    return error;
+}
+
+bool LedgerExporter::formatFromName(const QString &name, Format *format)
+{
+    QString n = name.toLower();
+    if (n == "csv")
+    {
+        *format = Csv;
+    }
+    else if (n == "json" || n == "jsonl")
+    {
+        *format = JsonLines;
+    }
+    else if (n == "columnar" || n == "coincol")
+    {
+        *format = Columnar;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+QString LedgerExporter::csvField(const QString &value)
+{
+    if (!value.contains(',') && !value.contains('"') && !value.contains('\n'))
+    {
+        return value;
+    }
+    QString escaped = value;
+    escaped.replace("\"", "\"\"");
+    return "\"" + escaped + "\"";
+}
+
+bool LedgerExporter::write(QIODevice *device, Format format)
+{
+    QSqlQuery q;
+    rows = 0;
+    error.clear();
+    if (!openCursor(q))
+    {
+        return false;
+    }
+    if (format == Columnar)
+    {
+        return writeColumnar(q, device);
+    }
+    return writeText(q, device, format);
+}
+
+/*
+ *  seeds the running balances with everything before the range, then opens the
+ *  forward-only cursor over the range in (account, date, pk_uid) order. split lines are
+ *  part of both, so the totals agree with the balance cache and the register
+ */
+bool LedgerExporter::openCursor(QSqlQuery &q)
+{
+    QString filter;
+    totals.clear();
+
+    if (accountId >= 0)
+    {
+        filter.append(" AND trans.id_account = :account");
+    }
+    if (fromDate.isValid())
+    {
+        QSqlQuery opening;
+        opening.setForwardOnly(true);
+        opening.prepare(QString("SELECT trans.id_account, SUM(trans.amount) FROM " exportLedger " WHERE trans.date_trans < :from")
+                        + (accountId >= 0 ? " AND trans.id_account = :account" : "") + " GROUP BY trans.id_account");
+        opening.bindValue(":from", fromDate.toJulianDay());
+        if (accountId >= 0) opening.bindValue(":account", accountId);
+        if (!opening.exec())
+        {
+            error = opening.lastError().text();
+            return false;
+        }
+        while (opening.next())
+        {
+            totals.insert(opening.value(0).toInt(), opening.value(1).toDouble());
+        }
+        filter.append(" AND trans.date_trans >= :from");
+    }
+    if (toDate.isValid())
+    {
+        filter.append(" AND trans.date_trans <= :to");
+    }
+
+    q.setForwardOnly(true);
+    q.prepare("SELECT trans.pk_uid, trans.id_account, account.account_name, account.currency, trans.date_trans, "
+              "trans.comment, trans.amount, trans.reconciled "
+              "FROM " exportLedger " LEFT JOIN account ON trans.id_account = account.pk_uid WHERE 1=1" + filter +
+              " ORDER BY trans.id_account, trans.date_trans, trans.pk_uid");
+    if (accountId >= 0) q.bindValue(":account", accountId);
+    if (fromDate.isValid()) q.bindValue(":from", fromDate.toJulianDay());
+    if (toDate.isValid()) q.bindValue(":to", toDate.toJulianDay());
+    if (!q.exec())
+    {
+        error = q.lastError().text();
+        return false;
+    }
+    return true;
+}
+
+/*
+ *  csv or json lines, one row at a time
+ */
+bool LedgerExporter::writeText(QSqlQuery &q, QIODevice *device, Format format)
+{
+    QTextStream out(device);
+    out.setCodec("UTF-8");
+
+    if (format == Csv)
+    {
+        out << "pk_uid,account,currency,date,comment,amount,total,reconciled\n";
+    }
+
+    while (q.next())
+    {
+        int account = q.value(export_id_account).toInt();
+        double amount = q.value(export_amount).toDouble();
+        double total = (totals[account] += amount);
+
+        if (format == Csv)
+        {
+            out << q.value(export_pk_uid).toInt() << ','
+                << csvField(q.value(export_account).toString()) << ','
+                << q.value(export_currency).toString() << ','
+                << QDate::fromJulianDay(q.value(export_date).toLongLong()).toString("yyyy-MM-dd") << ','
+                << csvField(q.value(export_comment).toString()) << ','
+                << QString::number(amount, 'f', 2) << ','
+                << QString::number(total, 'f', 2) << ','
+                << q.value(export_reconciled).toInt() << '\n';
+        }
+        else
+        {
+            QJsonObject o;
+            o.insert("pk_uid", q.value(export_pk_uid).toInt());
+            o.insert("account", q.value(export_account).toString());
+            o.insert("currency", q.value(export_currency).toString());
+            o.insert("date", QDate::fromJulianDay(q.value(export_date).toLongLong()).toString("yyyy-MM-dd"));
+            o.insert("comment", q.value(export_comment).toString());
+            o.insert("amount", amount);
+            o.insert("total", total);
+            o.insert("reconciled", q.value(export_reconciled).toInt() != 0);
+            out << QJsonDocument(o).toJson(QJsonDocument::Compact) << '\n';
+        }
+        ++rows;
+    }
+    out.flush();
+
+    if (out.status() != QTextStream::Ok)
+    {
+        error = device->errorString();
+        return false;
+    }
+    return true;
+}
+
+/*
+ *  compact column-oriented binary. little-endian layout:
+ *    "COINCOL1", quint32 column count, then per column a name (quint32 length + utf-8) and a type byte
+ *    (0 int64, 1 double, 2 string); then row groups of up to 65536 rows, each a quint32
+ *    row count followed by every column's values (strings as quint32 length + utf-8);
+ *    a row count of 0 ends the groups and is followed by the qint64 total row count.
+ *    dates are stored as julian day numbers
+ */
+bool LedgerExporter::writeColumnar(QSqlQuery &q, QIODevice *device)
+{
+    QDataStream out(device);
+    out.setByteOrder(QDataStream::LittleEndian);
+    out.setFloatingPointPrecision(QDataStream::DoublePrecision);
+
+    const char *names[] = { "pk_uid", "account", "currency", "date", "comment", "amount", "total", "reconciled" };
+    const quint8 types[] = { 0, 2, 2, 0, 2, 1, 1, 0 };
+    const int columns = 8;
+
+    out.writeRawData("COINCOL1", 8);
+    out << quint32(columns);
+    for (int i = 0; i < columns; ++i)
+    {
+        QByteArray name(names[i]);
+        out << quint32(name.size());
+        out.writeRawData(name.constData(), name.size());
+        out << types[i];
+    }
+
+    QVector<qint64> pk_uid, date, reconciled;
+    QVector<double> amount, total;
+    QList<QByteArray> account, currency, comment;
+
+    bool more = true;
+    while (more)
+    {
+        more = q.next();
+        if (more)
+        {
+            int accountId = q.value(export_id_account).toInt();
+            double a = q.value(export_amount).toDouble();
+            pk_uid.append(q.value(export_pk_uid).toLongLong());
+            account.append(q.value(export_account).toString().toUtf8());
+            currency.append(q.value(export_currency).toString().toUtf8());
+            date.append(q.value(export_date).toLongLong());
+            comment.append(q.value(export_comment).toString().toUtf8());
+            amount.append(a);
+            total.append(totals[accountId] += a);
+            reconciled.append(q.value(export_reconciled).toLongLong());
+            ++rows;
+        }
+
+        //flush a full row group, or whatever is left at the end
+        if (pk_uid.size() == exportRowGroupSize || (!more && !pk_uid.isEmpty()))
+        {
+            out << quint32(pk_uid.size());
+            writeInts(out, pk_uid);
+            writeStrings(out, account);
+            writeStrings(out, currency);
+            writeInts(out, date);
+            writeStrings(out, comment);
+            writeDoubles(out, amount);
+            writeDoubles(out, total);
+            writeInts(out, reconciled);
+            pk_uid.clear(); date.clear(); reconciled.clear();
+            amount.clear(); total.clear();
+            account.clear(); currency.clear(); comment.clear();
+        }
+    }
+    out << quint32(0) << rows;
+
+    if (out.status() != QDataStream::Ok)
+    {
+        error = device->errorString();
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,42 @@
+#ifndef LEDGEREXPORTER_H
+#define LEDGEREXPORTER_H
+
+#include <QDate>
+#include <QHash>
+#include <QIODevice>
+#include <QString>
+
+class QSqlQuery;
+
+/*
+ *  streams ledger rows (trans rows and split lines), with account names and running
+ *  balances, from a forward-only cursor straight to a device. only one row group is
+ *  ever held in memory
+ */
+class LedgerExporter
+{
+public:
+    enum Format { Csv, JsonLines, Columnar };
+
+    LedgerExporter();
+    void setAccount(int accountId);
+    void setDateRange(const QDate &from, const QDate &to);
+    bool write(QIODevice *device, Format format);
+    qint64 rowCount() const;
+    QString errorString() const;
+    static bool formatFromName(const QString &name, Format *format);
+    static QString csvField(const QString &value);
+
+private:
+    int accountId;
+    QDate fromDate;
+    QDate toDate;
+    qint64 rows;
+    QString error;
+    QHash<int,double> totals;   //running balance per account
+    bool openCursor(QSqlQuery &q);
+    bool writeText(QSqlQuery &q, QIODevice *device, Format format);
+    bool writeColumnar(QSqlQuery &q, QIODevice *device);
+};
+
+#endif // LEDGEREXPORTER_H
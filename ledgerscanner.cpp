@@ -0,0 +1,334 @@
+#include <QtSql>
+#include "ledgerscanner.h"
+#include "transactionsmodel.h"
+#include "definitions.h"
+
+LedgerScanner::LedgerScanner() :
+    loaded(false)
+{
+}
+
+/*
+ *  brings the findings up to date. the first call checks the whole ledger, later calls
+ *  only the rows changed since the previous scan and the rows that relate to them
+ */
+bool LedgerScanner::scan()
+{
+    QList<int> changed;
+    QList<qint64> hashes;
+    if (!rehash(&changed, &hashes)) return false;
+
+    if (!loaded)
+    {
+        found.clear();
+        if (!findDuplicates("SELECT hash FROM trans_hash GROUP BY hash HAVING COUNT(*) > 1")) return false;
+        if (!findBrokenTransfers(QString())) return false;
+        loaded = true;
+        return true;
+    }
+
+    if (changed.isEmpty())
+    {
+        return true;
+    }
+
+    QList<qint64> ids;
+    for (int i = 0; i < changed.size(); ++i)
+    {
+        ids.append(changed.at(i));
+    }
+    forget(changed);
+    if (!findDuplicates(numberList(hashes))) return false;
+    return findBrokenTransfers(" AND (t.pk_uid IN (" + numberList(ids) + ") OR t.id_relate IN (" + numberList(ids) + "))");
+}
+
+QList<Finding> LedgerScanner::findings() const
+{
+    return found.values();
+}
+
+/*
+ *  applies the fixes for the selected findings as one undoable operation:
+ *  duplicates are deleted, transfer legs are relinked, unlinked or given matching amounts
+ */
+bool LedgerScanner::fix(TransactionsModel *model, const QList<Finding> &selected)
+{
+    model->beginBulk(QObject::tr("Fix ledger findings"));
+    for (int i = 0; i < selected.size(); ++i)
+    {
+        Finding f = selected.at(i);
+        switch (f.kind)
+        {
+        case Finding::Duplicate:
+            model->deleteTransaction(f.pk_uid);
+            break;
+        case Finding::MissingMirror:
+            model->clearTransactionRelation(f.pk_uid);
+            break;
+        case Finding::UnlinkedMirror:
+        {
+            //link the other leg back if it is free, otherwise this row stops being a transfer
+            QSqlQuery q;
+            q.prepare("SELECT id_relate FROM trans WHERE pk_uid = ?");
+            q.addBindValue(f.otherId);
+            if (q.exec() && q.first() && q.value(0).isNull())
+            {
+                model->addTransactionRelation(f.otherId, f.pk_uid);
+            }
+            else
+            {
+                model->clearTransactionRelation(f.pk_uid);
+            }
+            break;
+        }
+        case Finding::AmountMismatch:
+            model->syncTransferAmount(f.pk_uid);
+            break;
+        }
+    }
+    return model->endBulk();
+}
+
+QString LedgerScanner::describe(const Finding &finding)
+{
+    switch (finding.kind)
+    {
+    case Finding::Duplicate:
+        return QObject::tr("Duplicate of #%1").arg(finding.otherId);
+    case Finding::MissingMirror:
+        return QObject::tr("Transfer leg #%1 is missing").arg(finding.otherId);
+    case Finding::UnlinkedMirror:
+        return QObject::tr("Transfer leg #%1 doesn't link back").arg(finding.otherId);
+    case Finding::AmountMismatch:
+        return QObject::tr("Amount doesn't match transfer leg #%1").arg(finding.otherId);
+    }
+    return QString();
+}
+
+/*
+ *  lowercases the comment and keeps only letters and digits, single spaced, so
+ *  "ACME  Corp." and "acme corp" hash the same
+ */
+QString LedgerScanner::normalizeComment(const QString &comment)
+{
+    QString normalized;
+    normalized.reserve(comment.size());
+    bool space = false;
+    for (int i = 0; i < comment.size(); ++i)
+    {
+        QChar c = comment.at(i).toLower();
+        if (c.isLetterOrNumber())
+        {
+            if (space && !normalized.isEmpty()) normalized.append(' ');
+            normalized.append(c);
+            space = false;
+        }
+        else
+        {
+            space = true;
+        }
+    }
+    return normalized;
+}
+
+/*
+ *  64-bit fnv-1a over the row's key. the value is stored, so it must not depend on the qt version
+ */
+qint64 LedgerScanner::rowHash(int accountId, qint64 date, double amount, const QString &comment)
+{
+    QByteArray key = QString("%1|%2|%3|%4").arg(accountId).arg(date).arg(qRound64(amount * 100))
+            .arg(normalizeComment(comment)).toUtf8();
+    quint64 h = Q_UINT64_C(14695981039346656037);
+    for (int i = 0; i < key.size(); ++i)
+    {
+        h ^= quint8(key.at(i));
+        h *= Q_UINT64_C(1099511628211);
+    }
+    return qint64(h);
+}
+
+/*
+ *  rehashes the rows listed in trans_dirty and empties it. changed gets the listed ids,
+ *  hashes the old and new hashes of those rows so their duplicate groups can be rechecked
+ */
+bool LedgerScanner::rehash(QList<int> *changed, QList<qint64> *hashes)
+{
+    QSqlDatabase db = QSqlDatabase::database();
+    QSqlQuery q;
+    q.setForwardOnly(true);
+
+    db.transaction();
+    if (!q.exec("SELECT d.pk_uid, h.hash FROM trans_dirty d LEFT JOIN trans_hash h ON h.pk_uid = d.pk_uid"))
+    {
+        db.rollback();
+        return false;
+    }
+    while (q.next())
+    {
+        changed->append(q.value(0).toInt());
+        if (!q.value(1).isNull()) hashes->append(q.value(1).toLongLong());
+    }
+    if (changed->isEmpty())
+    {
+        db.rollback();
+        return true;
+    }
+
+    QVariantList pk_uid, hash;
+    if (!q.exec("SELECT pk_uid, id_account, date_trans, amount, comment FROM trans WHERE pk_uid IN (SELECT pk_uid FROM trans_dirty)"))
+    {
+        db.rollback();
+        return false;
+    }
+    while (q.next())
+    {
+        qint64 h = rowHash(q.value(1).toInt(), q.value(2).toLongLong(), q.value(3).toDouble(), q.value(4).toString());
+        pk_uid << q.value(0).toInt();
+        hash << h;
+        hashes->append(h);
+    }
+
+    QSqlQuery insertQuery;
+    insertQuery.prepare("INSERT INTO trans_hash (pk_uid, hash) VALUES (?,?)");
+    insertQuery.addBindValue(pk_uid);
+    insertQuery.addBindValue(hash);
+    if (!q.exec("DELETE FROM trans_hash WHERE pk_uid IN (SELECT pk_uid FROM trans_dirty)")
+            || (!pk_uid.isEmpty() && !insertQuery.execBatch())
+            || !q.exec("DELETE FROM trans_dirty")
+            || !db.commit())
+    {
+        db.rollback();
+        return false;
+    }
+    return true;
+}
+
+/*
+ *  checks the rows whose hash is in hashFilter (a list or a subquery). rows that also
+ *  match on the actual key are grouped, and every row after the first is a duplicate of it
+ */
+bool LedgerScanner::findDuplicates(const QString &hashFilter)
+{
+    if (hashFilter.isEmpty()) return true;
+
+    QSqlQuery q;
+    q.setForwardOnly(true);
+    if (!q.exec("SELECT h.hash, t.pk_uid, t.id_account, t.date_trans, t.amount, t.comment "
+                "FROM trans_hash h JOIN trans t ON t.pk_uid = h.pk_uid "
+                "WHERE h.hash IN (" + hashFilter + ") ORDER BY h.hash, t.pk_uid"))
+    {
+        return false;
+    }
+
+    QHash<QString,int> first;    //exact key -> first pk_uid within the current hash
+    qint64 currentHash = 0;
+    while (q.next())
+    {
+        qint64 hash = q.value(0).toLongLong();
+        if (hash != currentHash || first.isEmpty())
+        {
+            first.clear();
+            currentHash = hash;
+        }
+
+        Finding f;
+        f.kind = Finding::Duplicate;
+        f.pk_uid = q.value(1).toInt();
+        f.id_account = q.value(2).toInt();
+        f.date = QDate::fromJulianDay(q.value(3).toLongLong());
+        f.amount = q.value(4).toDouble();
+        f.comment = q.value(5).toString();
+        found.remove(qMakePair(int(Finding::Duplicate), f.pk_uid));
+
+        QString key = QString("%1|%2|%3|%4").arg(f.id_account).arg(q.value(3).toLongLong())
+                .arg(qRound64(f.amount * 100)).arg(normalizeComment(f.comment));
+        if (!first.contains(key))
+        {
+            first.insert(key, f.pk_uid);
+            continue;
+        }
+        f.otherId = first.value(key);
+        found.insert(qMakePair(int(f.kind), f.pk_uid), f);
+    }
+    return true;
+}
+
+/*
+ *  one join over trans and the row its id_relate points at finds legs whose mirror is gone,
+ *  doesn't point back, or (in the same currency) doesn't carry the negated amount.
+ *  mismatched pairs are reported once, on the leg with the lower pk_uid
+ */
+bool LedgerScanner::findBrokenTransfers(const QString &rowFilter)
+{
+    QSqlQuery q;
+    q.setForwardOnly(true);
+    if (!q.exec("SELECT t.pk_uid, t.id_account, t.date_trans, t.amount, t.comment, t.id_relate, r.pk_uid, r.id_relate "
+                "FROM trans t LEFT JOIN trans r ON r.pk_uid = t.id_relate "
+                "LEFT JOIN account ta ON ta.pk_uid = t.id_account "
+                "LEFT JOIN account ra ON ra.pk_uid = r.id_account "
+                "WHERE t.id_relate IS NOT NULL AND (r.pk_uid IS NULL OR r.id_relate IS NULL OR r.id_relate <> t.pk_uid "
+                "OR (t.pk_uid < r.pk_uid AND COALESCE(ta.currency, '" baseCurrency "') = COALESCE(ra.currency, '" baseCurrency "') "
+                "AND ABS(t.amount + r.amount) > 0.005))" + rowFilter))
+    {
+        return false;
+    }
+
+    while (q.next())
+    {
+        Finding f;
+        f.pk_uid = q.value(0).toInt();
+        f.id_account = q.value(1).toInt();
+        f.date = QDate::fromJulianDay(q.value(2).toLongLong());
+        f.amount = q.value(3).toDouble();
+        f.comment = q.value(4).toString();
+        f.otherId = q.value(5).toInt();
+        if (q.value(6).isNull())
+        {
+            f.kind = Finding::MissingMirror;
+        }
+        else if (q.value(7).isNull() || q.value(7).toInt() != f.pk_uid)
+        {
+            f.kind = Finding::UnlinkedMirror;
+        }
+        else
+        {
+            f.kind = Finding::AmountMismatch;
+        }
+        found.insert(qMakePair(int(f.kind), f.pk_uid), f);
+    }
+    return true;
+}
+
+/*
+ *  drops the findings that involve any of the given rows before they are checked again
+ */
+void LedgerScanner::forget(const QList<int> &ids)
+{
+    QSet<int> changed;
+    for (int i = 0; i < ids.size(); ++i)
+    {
+        changed.insert(ids.at(i));
+    }
+    QMap<QPair<int,int>, Finding>::iterator i = found.begin();
+    while (i != found.end())
+    {
+        if (changed.contains(i->pk_uid) || changed.contains(i->otherId))
+        {
+            i = found.erase(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+QString LedgerScanner::numberList(const QList<qint64> &numbers)
+{
+    QStringList s;
+    for (int i = 0; i < numbers.size(); ++i)
+    {
+        s.append(QString::number(numbers.at(i)));
+    }
+    return s.join(",");
+}
@@ -0,0 +1,56 @@
+#ifndef LEDGERSCANNER_H
+#define LEDGERSCANNER_H
+
+#include <QDate>
+#include <QList>
+#include <QMap>
+#include <QPair>
+#include <QString>
+
+class TransactionsModel;
+
+/*
+ *  one problem found in the ledger. pk_uid is the row a fix would change,
+ *  otherId the row it duplicates or its transfer leg (-1 if there is none)
+ */
+struct Finding
+{
+    enum Kind { Duplicate, MissingMirror, UnlinkedMirror, AmountMismatch };
+
+    Kind kind;
+    int pk_uid;
+    int otherId;
+    int id_account;
+    QDate date;
+    QString comment;
+    double amount;
+};
+
+/*
+ *  finds repeated entries and broken transfers. every trans row has a hash of
+ *  (account, date, amount, normalized comment) in trans_hash, so duplicates are rows
+ *  sharing a hash. triggers list changed rows in trans_dirty, and after the first
+ *  full scan only those rows are rehashed and checked again
+ */
+class LedgerScanner
+{
+public:
+    LedgerScanner();
+    bool scan();
+    QList<Finding> findings() const;
+    bool fix(TransactionsModel *model, const QList<Finding> &selected);
+    static QString describe(const Finding &finding);
+    static QString normalizeComment(const QString &comment);
+    static qint64 rowHash(int accountId, qint64 date, double amount, const QString &comment);
+
+private:
+    QMap<QPair<int,int>, Finding> found;    //(kind, pk_uid) -> finding
+    bool loaded;
+    bool rehash(QList<int> *changed, QList<qint64> *hashes);
+    bool findDuplicates(const QString &hashFilter);
+    bool findBrokenTransfers(const QString &rowFilter);
+    void forget(const QList<int> &ids);
+    static QString numberList(const QList<qint64> &numbers);
+};
+
+#endif // LEDGERSCANNER_H
@@ -1,11 +1,24 @@
 #include <QApplication>
+#include <QStringList>
 #include "mainwindow.h"
+#include "definitions.h"
 
 int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
+    a.setOrganizationName("coin");    //names the QSettings store for the saved session
+    a.setApplicationName("coin");
 
-    MainWindow w;
+    //the database can be given as --db <path>, otherwise the default is used
+    QString databasePath = pathDB;
+    QStringList args = a.arguments();
+    int dbArg = args.indexOf("--db");
+    if (dbArg > 0 && dbArg + 1 < args.size())
+    {
+        databasePath = args.at(dbArg + 1);
+    }
+
+    MainWindow w(databasePath);
     w.show();
 
     return a.exec();
@@ -3,12 +3,20 @@
 #include "QMessageBox"
 #include "QtDebug"
 #include "definitions.h"
+#include "dialogsplits.h"
+#include "dialogbudgets.h"
+#include "dialogreview.h"
+#include "ledgerexporter.h"
+#include <QtConcurrent>
 #include <QLocale>
-
-//#define pathDB "/shared/coin/coin.db"
-#define pathDB "/home/spencer/dev/coin/coin/coin.db"
-
-MainWindow::MainWindow(QWidget *parent) :
+#include <QTreeWidgetItemIterator>
+#include <QFileDialog>
+#include <QInputDialog>
+#include <QScrollBar>
+#include <QSettings>
+#include <QTimer>
+
+MainWindow::MainWindow(const QString &databasePath, QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow)
 {
@@ -21,8 +29,8 @@ MainWindow::MainWindow(QWidget *parent) :
 
     //set the db and open
     db = QSqlDatabase::addDatabase("QSQLITE");
-    db.setDatabaseName(pathDB);
-    QFileInfo checkFile(pathDB);
+    db.setDatabaseName(databasePath);
+    QFileInfo checkFile(databasePath);
     if(!checkFile.isFile() or !db.open())
     {
         QMessageBox::critical(0, qApp->tr("Cannot open database"),
@@ -30,41 +38,162 @@ MainWindow::MainWindow(QWidget *parent) :
                      "Click Cancel to exit."), QMessageBox::Cancel);
         QApplication::quit();
     }
+    if(!TransactionsModel::createSchema())
+    {
+        QMessageBox::critical(0, qApp->tr("Cannot open database"),
+            qApp->tr("Unable to update the database schema."), QMessageBox::Cancel);
+    }
 
     //establish accounts and select first account
+    ui->treeAccounts->setColumnCount(2);    //second column holds the account balance
+    ui->treeAccounts->header()->setStretchLastSection(false);
+    ui->treeAccounts->header()->setSectionResizeMode(0,QHeaderView::Stretch);
+    ui->treeAccounts->header()->setSectionResizeMode(1,QHeaderView::ResizeToContents);
     refreshAccountTree();
     ui->treeAccounts->expandAll();
 
     //set up transactions table
     transactions = new TransactionsModel(this);
-    transactions->refresh();
-
-    //set up the filters
-    accountFilter = new QSortFilterProxyModel(this);
+    transactions->exchangeRates()->load();
+    rules.load();
+    connect(transactions,SIGNAL(journalChanged()),this,SLOT(updateUndoActions()));
+    connect(transactions,SIGNAL(journalChanged()),this,SLOT(refreshAccountBalances()));
+
+    //set up comment autocomplete. the index is built on a worker thread and
+    //kept current from the model afterwards
+    payeeModel = new QStringListModel(this);
+    payeeCompleter = new QCompleter(payeeModel,this);
+    payeeCompleter->setCompletionMode(QCompleter::UnfilteredPopupCompletion);
+    payeeCompleter->setCaseSensitivity(Qt::CaseInsensitive);
+    ui->lineEditTransactionInfo->setCompleter(payeeCompleter);
+    connect(payeeCompleter,SIGNAL(activated(QString)),this,SLOT(payeeSelected(QString)));
+    connect(transactions,SIGNAL(commentsChanged(QStringList)),this,SLOT(reloadPayees(QStringList)));
+    payeeWatcher = new QFutureWatcher< QVector<Payee> >(this);
+    connect(payeeWatcher,SIGNAL(finished()),this,SLOT(payeeIndexLoaded()));
+    payeeWatcher->setFuture(QtConcurrent::run(PayeeIndex::loadEntries,databasePath));
+    updateUndoActions();
+
+    //set up the filters. the account and date range are applied by the model's query
     reconcileFilter = new QSortFilterProxyModel(this);
     commentFilter = new QSortFilterProxyModel(this);
-    accountFilter->setFilterKeyColumn(col_id_account);
     reconcileFilter->setFilterKeyColumn(col_reconciled);
     commentFilter->setFilterKeyColumn(col_comment);
-    accountFilter->setDynamicSortFilter(true);
     reconcileFilter->setDynamicSortFilter(true);
     commentFilter->setDynamicSortFilter(true);
-    accountFilter->setSourceModel(transactions);
-    reconcileFilter->setSourceModel(accountFilter);
+    reconcileFilter->setSourceModel(transactions);
     commentFilter->setSourceModel(reconcileFilter);
+    ui->dateFrom->setDate(QDate::currentDate().addDays(-90));
+    ui->dateTo->setDate(QDate::currentDate());
+    ui->dateFrom->hide();   //the custom range dates only show when picked
+    ui->dateTo->hide();
+
+    ui->tableTransactions->setModel(commentFilter);         //filter the table for tag searches in the box
+
+    //header clicks sort in the query, not in the proxies. the columns themselves are set
+    //up once the first query has given the model its columns
+    QHeaderView *h = ui->tableTransactions->horizontalHeader();
+    h->setSectionsClickable(true);
+    h->setSortIndicatorShown(true);
+    connect(h,SIGNAL(sectionClicked(int)),this,SLOT(sortTransactions(int)));
+
+    //the model reads a page at a time. views fetch more rows at the bottom themselves,
+    //the pages above are read when the table is scrolled to the top
+    connect(ui->tableTransactions->verticalScrollBar(),SIGNAL(valueChanged(int)),this,SLOT(fetchEarlierRows()));
+
+    //put the last session's account and filters back, then load the ledger once the
+    //window is on screen
+    restoreSession();
+    QTimer::singleShot(0,this,SLOT(loadSession()));
+}
 
-    if (ui->treeAccounts->selectedItems().count() == 1)     //filter the table based on the selection in the accounts tree
+/*
+ *  sets the account and filters saved by the last session without loading anything.
+ *  signals are blocked so each restored setting doesn't reload the table
+ */
+void MainWindow::restoreSession()
+{
+    QSettings settings;
+    settings.beginGroup("session");
+
+    //select the saved account, or the first one (so that there is a selection active)
+    int accountId = settings.value("account",-1).toInt();
+    QTreeWidgetItem *selected = ui->treeAccounts->itemAt(0,0);
+    QTreeWidgetItemIterator i(ui->treeAccounts);
+    while (*i)
     {
-        accountFilter->setFilterFixedString(QString::number(getAccountId()));
+        if ((*i)->data(0,Qt::UserRole).toInt() == accountId)
+        {
+            selected = *i;
+        }
+        ++i;
     }
-    ui->tableTransactions->setModel(commentFilter);         //filter the table for tag searches in the box
+    ui->treeAccounts->blockSignals(true);
+    ui->treeAccounts->setCurrentItem(selected);
+    ui->treeAccounts->blockSignals(false);
+
+    ui->comboDateRange->blockSignals(true);
+    ui->dateFrom->blockSignals(true);
+    ui->dateTo->blockSignals(true);
+    ui->comboDateRange->setCurrentIndex(settings.value("dateRange",dateRangeAll).toInt());
+    ui->dateFrom->setDate(settings.value("dateFrom",ui->dateFrom->date()).toDate());
+    ui->dateTo->setDate(settings.value("dateTo",ui->dateTo->date()).toDate());
+    ui->dateFrom->setVisible(ui->comboDateRange->currentIndex() == dateRangeCustom);
+    ui->dateTo->setVisible(ui->comboDateRange->currentIndex() == dateRangeCustom);
+    ui->comboDateRange->blockSignals(false);
+    ui->dateFrom->blockSignals(false);
+    ui->dateTo->blockSignals(false);
+
+    //the table is still empty, so the proxy filters are cheap to set through their slots
+    ui->actionReconciled->setChecked(settings.value("unreconciledOnly",false).toBool());
+    on_actionReconciled_triggered(ui->actionReconciled->isChecked());
+    ui->lineEditFilter->setText(settings.value("filter").toString());
+
+    //sort keys are saved as "column:order" strings, most significant first
+    QStringList sort = settings.value("sort").toStringList();
+    for (int i = 0; i < sort.size(); ++i)
+    {
+        int column = sort.at(i).section(':',0,0).toInt();
+        if (TransactionsModel::isSortable(column))
+        {
+            sortKeys.append(qMakePair(column, Qt::SortOrder(sort.at(i).section(':',1,1).toInt())));
+        }
+    }
+    restoreTransactionId = settings.value("topTransaction",0).toInt();
+    restoreAtBottom = settings.value("atBottom",true).toBool();
+    settings.endGroup();
+}
 
-    //hide the pk_uid, id_account, and related account columns
-    //and size the remaining columns appropriately
+/*
+ *  first load of the ledger: only the screenful the last session showed is read. the
+ *  model reads further pages as the table scrolls
+ */
+void MainWindow::loadSession()
+{
+    transactions->setAccount(getAccountId());
+    transactions->setSortKeys(sortKeys);
+    updateDateRange();
+
+    int visibleRows = ui->tableTransactions->viewport()->height() / ui->tableTransactions->verticalHeader()->defaultSectionSize() + 1;
+    if (restoreAtBottom || !transactions->loadFrom(restoreTransactionId,visibleRows))
+    {
+        transactions->loadLast(visibleRows);
+    }
+    setupTransactionColumns();
+    restoreScrollPosition();
+}
+
+/*
+ *  hides the pk_uid, id_account, and related account columns and sizes the remaining
+ *  columns appropriately. the header only keeps these settings for sections that exist,
+ *  so this runs after the model's first query
+ */
+void MainWindow::setupTransactionColumns()
+{
     ui->tableTransactions->hideColumn(col_pk_uid);
     ui->tableTransactions->hideColumn(col_id_account);
     ui->tableTransactions->hideColumn(col_relate_account);
     ui->tableTransactions->hideColumn(col_reconciled);
+    ui->tableTransactions->hideColumn(col_currency);
     QHeaderView *h = ui->tableTransactions->horizontalHeader();
     h->setStretchLastSection(false);
     h->setSectionResizeMode(col_date,QHeaderView::Fixed);
@@ -74,9 +203,88 @@ MainWindow::MainWindow(QWidget *parent) :
     h->resizeSection(col_date,100);
     h->resizeSection(col_amount,100);
     h->resizeSection(col_total,120);
+    if (sortKeys.isEmpty())
+    {
+        h->setSortIndicator(col_date,Qt::AscendingOrder);
+    }
+    else
+    {
+        h->setSortIndicator(sortKeys.first().first,sortKeys.first().second);
+    }
+}
 
-    //select the first account (so that there is a selection active)
-    ui->treeAccounts->setCurrentItem(ui->treeAccounts->itemAt(0,0));
+/*
+ *  puts the view on the rows the last session left off at
+ */
+void MainWindow::restoreScrollPosition()
+{
+    QModelIndexList match;
+    if (!restoreAtBottom)
+    {
+        match = commentFilter->match(commentFilter->index(0,col_pk_uid),Qt::DisplayRole,restoreTransactionId,1,Qt::MatchExactly);
+    }
+    if (match.isEmpty())
+    {
+        ui->tableTransactions->scrollToBottom();
+    }
+    else
+    {
+        ui->tableTransactions->scrollTo(match.first(),QAbstractItemView::PositionAtTop);
+    }
+    fetchEarlierRows();
+
+    if ( ! ui->lblFilterTotal->isHidden() )
+    {
+        setFilterAmount();
+    }
+}
+
+/*
+ *  reads the page above the loaded rows once the table is scrolled to the top, keeping
+ *  the row that was at the top in place
+ */
+void MainWindow::fetchEarlierRows()
+{
+    QScrollBar *scroll = ui->tableTransactions->verticalScrollBar();
+    if (scroll->value() != scroll->minimum() || !transactions->canFetchPrevious())
+    {
+        return;
+    }
+    QPersistentModelIndex top = ui->tableTransactions->indexAt(QPoint(0,0));
+    transactions->fetchPrevious();
+    if (top.isValid())
+    {
+        ui->tableTransactions->scrollTo(top,QAbstractItemView::PositionAtTop);
+    }
+}
+
+/*
+ *  remembers the account, filters and scroll position for the next start
+ */
+void MainWindow::closeEvent(QCloseEvent *event)
+{
+    QSettings settings;
+    settings.beginGroup("session");
+    settings.setValue("account",getAccountId());
+    settings.setValue("dateRange",ui->comboDateRange->currentIndex());
+    settings.setValue("dateFrom",ui->dateFrom->date());
+    settings.setValue("dateTo",ui->dateTo->date());
+    settings.setValue("unreconciledOnly",ui->actionReconciled->isChecked());
+    settings.setValue("filter",ui->lineEditFilter->text());
+    QStringList sort;
+    for (int i = 0; i < sortKeys.size(); ++i)
+    {
+        sort.append(QString("%1:%2").arg(sortKeys.at(i).first).arg(int(sortKeys.at(i).second)));
+    }
+    settings.setValue("sort",sort);
+
+    QScrollBar *scroll = ui->tableTransactions->verticalScrollBar();
+    QModelIndex top = ui->tableTransactions->indexAt(QPoint(0,0));
+    settings.setValue("atBottom",scroll->value() == scroll->maximum());
+    settings.setValue("topTransaction",top.isValid() ? commentFilter->data(commentFilter->index(top.row(),col_pk_uid)).toInt() : 0);
+    settings.endGroup();
+
+    QMainWindow::closeEvent(event);
 }
 
 MainWindow::~MainWindow()
@@ -122,13 +330,42 @@ void MainWindow::refreshAccountTree()
             itmParent->addChild(itmChild);
         }
     }
+
+    refreshAccountBalances();
+}
+
+/*
+ *  fills the balance column of the account tree from the cached balances
+ */
+void MainWindow::refreshAccountBalances()
+{
+    QHash<int,double> balances;
+    QHash<int,QString> currencies;
+
+    QSqlQuery q;
+    q.exec("SELECT account.pk_uid, account_balance.balance, account.currency FROM account LEFT JOIN account_balance ON account.pk_uid = account_balance.id_account");
+    while (q.next())
+    {
+        balances.insert(q.value(0).toInt(),q.value(1).toDouble());
+        currencies.insert(q.value(0).toInt(),q.value(2).toString());
+    }
+
+    QTreeWidgetItemIterator i(ui->treeAccounts);
+    while (*i)
+    {
+        int accountId = (*i)->data(0,Qt::UserRole).toInt();
+        (*i)->setText(1,ExchangeRates::formatAmount(balances.value(accountId),currencies.value(accountId)));
+        (*i)->setTextAlignment(1,Qt::AlignRight);
+        ++i;
+    }
 }
 
 void MainWindow::on_btnAccept_clicked()
 {
     double transactionAmount, transferAmount;
     int accountId, transferAccountId, firstTransactionId, secondTransactionId;
-    QString transactionComment, transactionDate;
+    QString transactionComment;
+    QDate transactionDate;
 
     //get the account id and the information from the fields
     accountId = getAccountId();
@@ -136,46 +373,39 @@ void MainWindow::on_btnAccept_clicked()
     transactionAmount = ui->lineEditAmount->text().toDouble();
     transferAmount = transactionAmount*-1;
     transactionComment = ui->lineEditTransactionInfo->text();
-    transactionDate = ui->dateEdit->date().toString("yyyy-MM-dd");
+    transactionDate = ui->dateEdit->date();
 
     //check to see if this is a transfer
     if (ui->transferCheckBox->isChecked())  //this is a transfer
     {
-        QSqlQuery q;
-
-        //perform the first part of the transfer. if it fails, kick out an error message and exit routine
-        if(!transactions->addTransaction(accountId,transactionDate,transactionComment,transactionAmount))
+        //when the accounts use different currencies, the other leg is stored in its own currency
+        bool rateFound;
+        transferAmount = -1 * transactions->exchangeRates()->convert(transactionAmount,
+                                                                     TransactionsModel::accountCurrency(accountId),
+                                                                     TransactionsModel::accountCurrency(transferAccountId),
+                                                                     ui->dateEdit->date(), &rateFound);
+        if (!rateFound)
         {
-            transactionFailedError(qApp->tr("Could not add transaction."));
+            transactionFailedError(qApp->tr("No exchange rate is available for this transfer."));
             return;
         }
 
-        //get the id of the first part of the transfer
-        q.exec("SELECT last_insert_rowid()");
-        q.first();
-        firstTransactionId = q.value(0).toInt();
+        //both legs and their relations are one undo step. if any part fails, nothing is kept
+        transactions->beginBulk(qApp->tr("Add transfer"));
 
-        //perform the second part of the transfer. if it fails, kick out an error message and exit routine
-        if(!transactions->addTransaction(transferAccountId,transactionDate,transactionComment,transferAmount))
-        {
-            transactionFailedError(qApp->tr("Could not add transaction."));
-            return;
-        }
+        //perform the first part of the transfer and get its id
+        transactions->addTransaction(accountId,transactionDate,transactionComment,transactionAmount);
+        firstTransactionId = transactions->lastTransactionId();
 
-        //get the id of the second part of the transfer
-        q.clear();
-        q.exec("SELECT last_insert_rowid()");
-        q.first();
-        q.value(0);
-        secondTransactionId = q.value(0).toInt();
+        //perform the second part of the transfer and get its id
+        transactions->addTransaction(transferAccountId,transactionDate,transactionComment,transferAmount);
+        secondTransactionId = transactions->lastTransactionId();
 
-        if(!transactions->addTransactionRelation(firstTransactionId,secondTransactionId))
-        {
-            transactionFailedError(qApp->tr("Could not add transaction."));
-            return;
-        }
+        transactions->addTransactionRelation(firstTransactionId,secondTransactionId);
+        transactions->addTransactionRelation(secondTransactionId,firstTransactionId);
 
-        if(!transactions->addTransactionRelation(secondTransactionId,firstTransactionId))
+        //if it fails, kick out an error message and exit routine
+        if(!transactions->endBulk())
         {
             transactionFailedError(qApp->tr("Could not add transaction."));
             return;
@@ -183,8 +413,11 @@ void MainWindow::on_btnAccept_clicked()
     }
     else  //this is not a transfer
     {
-        //perform the transaction. if it fails, kick out an error message
-        if(!transactions->addTransaction(accountId,transactionDate,transactionComment,transactionAmount))
+        //perform the transaction and let the rules categorize it. if it fails, kick out an error message
+        transactions->beginBulk(qApp->tr("Add transaction"));
+        transactions->addTransaction(accountId,transactionDate,transactionComment,transactionAmount);
+        transactions->categorize(rules,QList<int>() << transactions->lastTransactionId());
+        if(!transactions->endBulk())
         {
             transactionFailedError(qApp->tr("Could not add transaction."));
             return;
@@ -209,8 +442,8 @@ void MainWindow::on_btnAccept_clicked()
 
 void MainWindow::on_treeAccounts_itemSelectionChanged()
 {
+    transactions->setAccount(getAccountId());
     transactions->refresh();
-    accountFilter->setFilterFixedString(QString::number(getAccountId()));
 
     //if the transfer combobox is showing, update the accounts to reflect the change
     if (ui->transferCheckBox->checkState() == Qt::Checked)
@@ -229,6 +462,121 @@ void MainWindow::on_treeAccounts_itemSelectionChanged()
     }
 }
 
+/*
+ *  a header click makes that column the first sort key; clicking it again reverses it.
+ *  the previous keys are kept behind it, so sorting by amount then date orders each
+ *  date's rows by amount
+ */
+void MainWindow::sortTransactions(int column)
+{
+    QHeaderView *h = ui->tableTransactions->horizontalHeader();
+    if (!TransactionsModel::isSortable(column))
+    {
+        h->setSortIndicator(sortKeys.isEmpty() ? col_date : sortKeys.first().first,
+                            sortKeys.isEmpty() ? Qt::AscendingOrder : sortKeys.first().second);
+        return;
+    }
+
+    Qt::SortOrder order = Qt::AscendingOrder;
+    if (!sortKeys.isEmpty() && sortKeys.first().first == column)
+    {
+        order = sortKeys.first().second == Qt::AscendingOrder ? Qt::DescendingOrder : Qt::AscendingOrder;
+    }
+    for (int i = sortKeys.size() - 1; i >= 0; --i)
+    {
+        if (sortKeys.at(i).first == column) sortKeys.removeAt(i);
+    }
+    sortKeys.prepend(qMakePair(column,order));
+    while (sortKeys.size() > 3)
+    {
+        sortKeys.removeLast();
+    }
+    h->setSortIndicator(column,order);
+
+    transactions->setSortKeys(sortKeys);
+    if (column == col_date && order == Qt::AscendingOrder)
+    {
+        transactions->refresh();
+        ui->tableTransactions->scrollToBottom();
+    }
+    else
+    {
+        transactions->loadFirst(transactionPageRows);
+        ui->tableTransactions->scrollToTop();
+    }
+}
+
+/*
+ *  picks the date range shown in the table. presets are relative to today and leave
+ *  the end open so future-dated transactions stay visible
+ */
+void MainWindow::on_comboDateRange_currentIndexChanged(int index)
+{
+    bool custom = (index == dateRangeCustom);
+    ui->dateFrom->setVisible(custom);
+    ui->dateTo->setVisible(custom);
+    applyDateRange();
+}
+
+void MainWindow::on_dateFrom_dateChanged(const QDate &/*date*/)
+{
+    if (ui->comboDateRange->currentIndex() == dateRangeCustom)
+    {
+        applyDateRange();
+    }
+}
+
+void MainWindow::on_dateTo_dateChanged(const QDate &/*date*/)
+{
+    if (ui->comboDateRange->currentIndex() == dateRangeCustom)
+    {
+        applyDateRange();
+    }
+}
+
+void MainWindow::applyDateRange()
+{
+    updateDateRange();
+    transactions->refresh();
+    ui->tableTransactions->scrollToBottom();
+
+    //reset filtered amount label if visible
+    if ( ! ui->lblFilterTotal->isHidden() )
+    {
+        setFilterAmount();
+    }
+}
+
+/*
+ *  passes the range picked in the filter bar to the model without reloading it
+ */
+void MainWindow::updateDateRange()
+{
+    QDate today = QDate::currentDate();
+
+    switch (ui->comboDateRange->currentIndex())
+    {
+    case dateRange30Days:
+        transactions->setDateRange(today.addDays(-30), QDate());
+        break;
+    case dateRange90Days:
+        transactions->setDateRange(today.addDays(-90), QDate());
+        break;
+    case dateRange365Days:
+        transactions->setDateRange(today.addDays(-365), QDate());
+        break;
+    case dateRangeYearToDate:
+        transactions->setDateRange(QDate(today.year(),1,1), QDate());
+        break;
+    case dateRangeCustom:
+        transactions->setDateRange(ui->dateFrom->date(), ui->dateTo->date());
+        break;
+    default:
+        transactions->setDateRange(QDate(), QDate());
+        break;
+    }
+}
+
 /*
  *  returns the pk_uid of the account selected in the account tree view
  */
@@ -318,6 +666,20 @@ void MainWindow::on_tableTransactions_customContextMenuRequested(const QPoint &p
     reconcileAction->setData("reconcile");
     transactionsMenu->addAction(reconcileAction);
 
+    //add the split action for a single transaction that isn't a transfer
+    if (ui->tableTransactions->selectionModel()->selectedRows().count() == 1)
+    {
+        int row = ui->tableTransactions->selectionModel()->selectedRows().first().row();
+        QModelIndex relateIndex = ui->tableTransactions->model()->index(row,col_relate_account);
+        if (ui->tableTransactions->model()->data(relateIndex).toString().isEmpty())
+        {
+            QAction *splitAction;
+            splitAction = new QAction("Split transaction...",transactionsMenu);
+            splitAction->setData("split");
+            transactionsMenu->addAction(splitAction);
+        }
+    }
+
     //query the accounts
     q.prepare("SELECT pk_uid, account_name FROM account WHERE pk_uid <> ? ORDER BY account_name");
     q.addBindValue(QString::number(getAccountId()));
@@ -335,7 +697,11 @@ void MainWindow::on_tableTransactions_customContextMenuRequested(const QPoint &p
     //show the menu and get the selected menu item
     QAction *selectedMenuItem = transactionsMenu->exec(globalPos);
 
-    if (selectedMenuItem)
+    if (selectedMenuItem && selectedMenuItem->data() == "split")
+    {
+        editSplits(getTransactionId(ui->tableTransactions->selectionModel()->selectedRows().first().row()));
+    }
+    else if (selectedMenuItem)
     {
         QItemSelectionModel *rowsSelectionModel;
         QModelIndexList rowsList;
@@ -345,17 +711,36 @@ void MainWindow::on_tableTransactions_customContextMenuRequested(const QPoint &p
         rowsList = rowsSelectionModel->selectedRows(col_pk_uid);
 
         //iterate through the selection and perform the selected task on each
-        //selected transaction
+        //selected transaction. the whole selection is one undo step
+        QString description;
+        if (selectedMenuItem->data() == "delete")
+        {
+            description = qApp->tr("Delete transactions");
+        }
+        else if (selectedMenuItem->data() == "reconcile")
+        {
+            description = qApp->tr("Reconcile transactions");
+        }
+        else
+        {
+            description = qApp->tr("Move transactions");
+        }
+        transactions->beginBulk(description);
         QList<QModelIndex>::Iterator i;
         for (i = rowsList.begin(); i != rowsList.end(); ++i)
         {
             int transactionId;
             transactionId = i->data().toInt();
+            if (transactionId < 0)
+            {
+                continue;   //split lines shown in this account are changed through their parent
+            }
 
             if(selectedMenuItem->data() == "delete")  //if the user clicked on "delete this transaction"
             {
                 if(!transactions->deleteTransaction(transactionId))
                 {
+                    transactions->endBulk();
                     transactionFailedError(qApp->tr("Could not delete transaction."));
                     return;
                 }
@@ -364,6 +749,7 @@ void MainWindow::on_tableTransactions_customContextMenuRequested(const QPoint &p
             {
                 if(!transactions->setReconcile(transactionId,true))
                 {
+                    transactions->endBulk();
                     transactionFailedError(qApp->tr("Could not set as reconciled."));
                     return;
                 }
@@ -374,17 +760,40 @@ void MainWindow::on_tableTransactions_customContextMenuRequested(const QPoint &p
 
                 if (!transactions->moveTransaction(accountId, transactionId))
                 {
+                    transactions->endBulk();
                     transactionFailedError(qApp->tr("Could not move transaction."));
                     return;
                 }
             }
         }
+        transactions->endBulk();
 
         transactions->refresh();
         ui->tableTransactions->scrollToBottom();
     }
 }
 
+/*
+ *  opens the split editor for a transaction and saves the changed lines
+ */
+void MainWindow::editSplits(int transactionId)
+{
+    QString currency = TransactionsModel::accountCurrency(getAccountId());
+    QVector<SplitLine> lines = transactions->splits(transactionId);
+    DialogSplits dialog(lines,currency,this);
+    if (dialog.exec() != QDialog::Accepted)
+    {
+        return;
+    }
+
+    if (!transactions->setSplits(transactionId,dialog.lines()))
+    {
+        transactionFailedError(qApp->tr("Could not split transaction."));
+        return;
+    }
+    transactions->refresh();
+}
+
 /*
  *  toggle checkbox for a transfer
  */
@@ -426,6 +835,7 @@ void MainWindow::fillAccountCombo()
 void MainWindow::on_lineEditFilter_textChanged(const QString &arg1)
 {
     commentFilter->setFilterRegExp(arg1);
+    transactions->setLoadAll(0 < arg1.length() || ui->actionReconciled->isChecked());
     if (0 < arg1.length())
     {
         ui->lblFilterTotal->show();
@@ -461,15 +871,70 @@ void MainWindow::on_btnDeleteAccount_clicked()
     {
         int accountId = getAccountId();
 
-        //remove any transactions associated with this account
+        //remove the account's transactions with their transfer mirrors and split lines, and
+        //take the account's lines out of other transactions' splits. going through the model
+        //keeps the other accounts' balances and budgets current
         QSqlQuery q;
-        q.prepare("DELETE FROM trans WHERE id_account = ?");
+        QList<int> ids;
+        QList<int> splitParents;
+        q.prepare("SELECT pk_uid FROM trans WHERE id_account = ?");
         q.addBindValue(accountId);
-        if(!q.exec())
+        q.exec();
+        while (q.next())
+        {
+            ids.append(q.value(0).toInt());
+        }
+        q.prepare("SELECT DISTINCT s.id_trans FROM trans_split s JOIN trans t ON t.pk_uid = s.id_trans "
+                  "WHERE s.id_account = ? AND t.id_account <> ?");
+        q.addBindValue(accountId);
+        q.addBindValue(accountId);
+        q.exec();
+        while (q.next())
+        {
+            splitParents.append(q.value(0).toInt());
+        }
+
+        transactions->beginBulk(qApp->tr("Delete account"));
+        for (int i = 0; i < ids.size(); ++i)
+        {
+            transactions->deleteTransaction(ids[i]);
+        }
+        for (int i = 0; i < splitParents.size(); ++i)
+        {
+            QVector<SplitLine> lines = transactions->splits(splitParents.at(i));
+            QVector<SplitLine> kept;
+            for (int j = 0; j < lines.size(); ++j)
+            {
+                if (lines.at(j).id_account != accountId) kept.append(lines.at(j));
+            }
+            transactions->setSplits(splitParents.at(i), kept);
+        }
+        if (!transactions->endBulk())
         {
             transactionFailedError(qApp->tr("Could not delete account"));
+            return;
         }
 
+        //the undo entries can't bring back rows of an account that no longer exists
+        transactions->clearUndo();
+
+        //remove the cached balance
+        q.clear();
+        q.prepare("DELETE FROM account_balance WHERE id_account = ?");
+        q.addBindValue(accountId);
+        q.exec();
+
+        //drop the account's budget and recount the budgets it was part of
+        q.clear();
+        q.prepare("DELETE FROM budget_month WHERE id_budget IN (SELECT pk_uid FROM budget WHERE id_account = ?)");
+        q.addBindValue(accountId);
+        q.exec();
+        q.clear();
+        q.prepare("DELETE FROM budget WHERE id_account = ?");
+        q.addBindValue(accountId);
+        q.exec();
+        TransactionsModel::rebuildBudgets();
+
         //remove the account
         q.clear();
         q.prepare("DELETE FROM account WHERE pk_uid = ?");
@@ -492,6 +957,7 @@ void MainWindow::on_actionReconciled_triggered(bool checked)
     {
         reconcileFilter->setFilterFixedString(QString());
     }
+    transactions->setLoadAll(checked || 0 < ui->lineEditFilter->text().length());
     return;
 }
 
@@ -517,9 +983,284 @@ float MainWindow::sumColumn(int column)
 void MainWindow::setFilterAmount()
 {
     QString amt;
-    QLocale us(QLocale::English,QLocale::UnitedStates);
 
     amt = "Filter total: ";
-    amt.append(us.toCurrencyString(sumColumn(col_amount),us.currencySymbol()));
+    amt.append(ExchangeRates::formatAmount(sumColumn(col_amount),TransactionsModel::accountCurrency(getAccountId())));
     ui->lblFilterTotal->setText(amt);
 }
+
+/*
+ *  undo the last change to the ledger
+ */
+void MainWindow::on_actionUndo_triggered()
+{
+    if(!transactions->undo())
+    {
+        transactionFailedError(qApp->tr("Could not undo."));
+        return;
+    }
+    transactions->refresh();
+}
+
+/*
+ *  redo the last undone change
+ */
+void MainWindow::on_actionRedo_triggered()
+{
+    if(!transactions->redo())
+    {
+        transactionFailedError(qApp->tr("Could not redo."));
+        return;
+    }
+    transactions->refresh();
+}
+
+/*
+ *  keeps the undo/redo menu items in step with the journal
+ */
+void MainWindow::updateUndoActions()
+{
+    ui->actionUndo->setEnabled(transactions->canUndo());
+    ui->actionRedo->setEnabled(transactions->canRedo());
+    ui->actionUndo->setText(transactions->canUndo() ? qApp->tr("Undo ") + transactions->undoText() : qApp->tr("Undo"));
+    ui->actionRedo->setText(transactions->canRedo() ? qApp->tr("Redo ") + transactions->redoText() : qApp->tr("Redo"));
+}
+
+/*
+ *  loads exchange rates from a "currency,yyyy-MM-dd,rate" file
+ */
+void MainWindow::on_actionImportRates_triggered()
+{
+    QString path = QFileDialog::getOpenFileName(this, qApp->tr("Import exchange rates"), QString(), qApp->tr("Rate files (*.csv *.txt);;All files (*)"));
+    if (path.isEmpty())
+    {
+        return;
+    }
+
+    QString errorMessage;
+    if (!transactions->exchangeRates()->importFile(path, &errorMessage))
+    {
+        transactionFailedError(qApp->tr("Could not import exchange rates.\n") + errorMessage);
+        return;
+    }
+    TransactionsModel::rebuildBudgets();    //budget totals are converted at the imported rates
+}
+
+/*
+ *  sets the iso currency code of the selected account
+ */
+void MainWindow::on_actionAccountCurrency_triggered()
+{
+    int accountId = getAccountId();
+    if (accountId < 0)
+    {
+        return;
+    }
+
+    bool ok;
+    QString currency = QInputDialog::getText(this, qApp->tr("Account currency"),
+                                             qApp->tr("Currency code for %1:").arg(getAccountName()),
+                                             QLineEdit::Normal, TransactionsModel::accountCurrency(accountId), &ok).trimmed().toUpper();
+    if (!ok || currency.length() != 3)
+    {
+        return;
+    }
+
+    QSqlQuery q;
+    q.prepare("UPDATE account SET currency = ? WHERE pk_uid = ?");
+    q.addBindValue(currency);
+    q.addBindValue(accountId);
+    if (!q.exec())
+    {
+        transactionFailedError(qApp->tr("Could not set the account currency."));
+        return;
+    }
+    TransactionsModel::rebuildBudgets();    //budgets above the account may convert its amounts now
+    refreshAccountBalances();
+    transactions->refresh();
+}
+
+/*
+ *  shows the net worth of all accounts in the base currency. balances come from the
+ *  balance cache and are converted once per currency through the rate cache
+ */
+void MainWindow::on_actionNetWorth_triggered()
+{
+    QDate today = QDate::currentDate();
+    double netWorth = 0;
+    QString details;
+    bool missingRate = false;
+
+    QSqlQuery q;
+    q.exec("SELECT COALESCE(account.currency, '" baseCurrency "'), SUM(account_balance.balance) "
+           "FROM account_balance JOIN account ON account.pk_uid = account_balance.id_account "
+           "GROUP BY 1 ORDER BY 1");
+    while (q.next())
+    {
+        QString currency = q.value(0).toString();
+        double balance = q.value(1).toDouble();
+        bool ok;
+        netWorth += transactions->exchangeRates()->convert(balance, currency, baseCurrency, today, &ok);
+        missingRate = missingRate || !ok;
+        details.append(currency + ": " + ExchangeRates::formatAmount(balance, currency) + "\n");
+    }
+
+    details.append("\n" + qApp->tr("Net worth: ") + ExchangeRates::formatAmount(netWorth, baseCurrency));
+    if (missingRate)
+    {
+        details.append("\n" + qApp->tr("Some currencies have no exchange rate and were counted at par."));
+    }
+    QMessageBox::information(this, qApp->tr("Net worth"), details);
+}
+
+/*
+ *  exports the selected account. the format follows the file extension
+ */
+void MainWindow::on_actionExport_triggered()
+{
+    QString path = QFileDialog::getSaveFileName(this, qApp->tr("Export account"), QString(),
+                                                qApp->tr("CSV (*.csv);;JSON Lines (*.jsonl);;Columnar (*.coincol)"));
+    if (path.isEmpty())
+    {
+        return;
+    }
+
+    LedgerExporter::Format format;
+    if (!LedgerExporter::formatFromName(QFileInfo(path).suffix(), &format))
+    {
+        format = LedgerExporter::Csv;
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        transactionFailedError(qApp->tr("Could not open ") + path);
+        return;
+    }
+
+    LedgerExporter exporter;
+    exporter.setAccount(getAccountId());
+    if (!exporter.write(&file, format))
+    {
+        transactionFailedError(qApp->tr("Export failed.\n") + exporter.errorString());
+    }
+}
+
+/*
+ *  adds a rule that sends transactions whose comment contains a pattern to the selected account
+ */
+void MainWindow::on_actionAddRule_triggered()
+{
+    int accountId = getAccountId();
+    if (accountId < 0)
+    {
+        return;
+    }
+
+    bool ok;
+    QString pattern = QInputDialog::getText(this, qApp->tr("Add rule"),
+                                            qApp->tr("Move transactions whose comment contains this text to %1:").arg(getAccountName()),
+                                            QLineEdit::Normal, QString(), &ok).trimmed();
+    if (!ok || pattern.isEmpty())
+    {
+        return;
+    }
+
+    QSqlQuery q;
+    q.prepare("INSERT INTO rule (pattern, id_account) VALUES (?,?)");
+    q.addBindValue(pattern);
+    q.addBindValue(accountId);
+    if (!q.exec() || !rules.load())
+    {
+        transactionFailedError(qApp->tr("Could not add rule."));
+    }
+}
+
+/*
+ *  runs the rules over the whole ledger as one undoable step
+ */
+void MainWindow::on_actionCategorize_triggered()
+{
+    int moved;
+    if (!transactions->categorizeAll(rules,&moved))
+    {
+        transactionFailedError(qApp->tr("Could not categorize transactions."));
+        return;
+    }
+    transactions->refresh();
+    ui->statusBar->showMessage(qApp->tr("%1 transactions categorized").arg(moved),5000);
+}
+
+/*
+ *  shows spent against planned for each budget, month by month
+ */
+void MainWindow::on_actionBudgets_triggered()
+{
+    DialogBudgets dialog(this);
+    dialog.exec();
+}
+
+/*
+ *  lists duplicate entries and broken transfers. the scanner lives as long as the
+ *  window, so reopening the review only rescans what changed in between
+ */
+void MainWindow::on_actionReview_triggered()
+{
+    DialogReview dialog(&scanner,transactions,this);
+    dialog.exec();
+    transactions->refresh();
+}
+
+/*
+ *  installs the comment index once the background load is done
+ */
+void MainWindow::payeeIndexLoaded()
+{
+    payees.install(payeeWatcher->result());
+}
+
+void MainWindow::reloadPayees(const QStringList &comments)
+{
+    payees.reload(comments);
+}
+
+/*
+ *  offers the most used comments starting with what was typed
+ */
+void MainWindow::on_lineEditTransactionInfo_textEdited(const QString &arg1)
+{
+    payeeModel->setStringList(payees.lookup(arg1,payeeLookupRows));
+}
+
+/*
+ *  pre-fills the amount and transfer account last used with the chosen comment
+ */
+void MainWindow::payeeSelected(const QString &comment)
+{
+    const Payee *p = payees.find(comment);
+    if (!p)
+    {
+        return;
+    }
+
+    //the last use may have been recorded from the other leg of a transfer. seen from
+    //this account, that leg's account is the transfer target and the amount flips
+    double amount = p->lastAmount;
+    int transferAccountId = p->lastTransferAccount;
+    if (transferAccountId >= 0 && transferAccountId == getAccountId())
+    {
+        amount = -amount;
+        transferAccountId = p->lastAccount;
+    }
+
+    ui->lineEditAmount->setText(QString::number(amount,'f',2));
+    if (transferAccountId >= 0 && transferAccountId != getAccountId())
+    {
+        ui->transferCheckBox->setChecked(true);
+        ui->comboAccounts->setCurrentIndex(ui->comboAccounts->findData(transferAccountId));
+    }
+    else
+    {
+        ui->transferCheckBox->setChecked(false);
+    }
+}
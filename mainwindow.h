@@ -4,6 +4,11 @@
 #include <QMainWindow>
 #include <QDebug>
 #include "transactionsmodel.h"
+#include "payeeindex.h"
+#include "ledgerscanner.h"
+#include <QCompleter>
+#include <QFutureWatcher>
+#include <QStringListModel>
 #include <QtSql>
 #include <QFileInfo>
 #include <QtCore>
@@ -18,9 +23,12 @@ class MainWindow : public QMainWindow
     Q_OBJECT
 
 public:
-    explicit MainWindow(QWidget *parent = 0);
+    explicit MainWindow(const QString &databasePath, QWidget *parent = 0);
     ~MainWindow();
 
+protected:
+    void closeEvent(QCloseEvent *event);
+
 private slots:
     void on_btnAccept_clicked();
     void on_treeAccounts_itemSelectionChanged();
@@ -30,15 +38,46 @@ private slots:
     void on_btnAddAccount_clicked();
     void on_btnDeleteAccount_clicked();
     void on_actionReconciled_triggered(bool checked);
+    void on_actionUndo_triggered();
+    void on_actionRedo_triggered();
+    void on_actionImportRates_triggered();
+    void on_actionAccountCurrency_triggered();
+    void on_actionNetWorth_triggered();
+    void on_actionExport_triggered();
+    void on_actionAddRule_triggered();
+    void on_actionCategorize_triggered();
+    void on_actionBudgets_triggered();
+    void on_actionReview_triggered();
+    void on_lineEditTransactionInfo_textEdited(const QString &arg1);
+    void on_comboDateRange_currentIndexChanged(int index);
+    void on_dateFrom_dateChanged(const QDate &date);
+    void on_dateTo_dateChanged(const QDate &date);
+    void payeeIndexLoaded();
+    void reloadPayees(const QStringList &comments);
+    void payeeSelected(const QString &comment);
+    void updateUndoActions();
+    void refreshAccountBalances();
+    void loadSession();
+    void restoreScrollPosition();
+    void fetchEarlierRows();
+    void sortTransactions(int column);
 
 private:
     Ui::MainWindow *ui;
     QSqlDatabase db;
     QStandardItemModel *accountsTree;
     TransactionsModel *transactions;
-    QSortFilterProxyModel *accountFilter;
+    RuleMatcher rules;
+    PayeeIndex payees;
+    LedgerScanner scanner;
+    QStringListModel *payeeModel;
+    QCompleter *payeeCompleter;
+    QFutureWatcher< QVector<Payee> > *payeeWatcher;
     QSortFilterProxyModel *reconcileFilter;
     QSortFilterProxyModel *commentFilter;
+    QList<QPair<int,Qt::SortOrder> > sortKeys;    //header sort, most significant first
+    int restoreTransactionId;
+    bool restoreAtBottom;
     int getAccountId();
     QString getAccountName();
     int getTransactionId();
@@ -48,6 +87,11 @@ private:
     void refreshAccountTree();
     float sumColumn(int column);
     void setFilterAmount();
+    void editSplits(int transactionId);
+    void applyDateRange();
+    void updateDateRange();
+    void restoreSession();
+    void setupTransactionColumns();
 };
 
 #endif // MAINWINDOW_H
@@ -0,0 +1,350 @@
+#include <QtSql>
+#include <QThread>
+#include <algorithm>
+#include "payeeindex.h"
+#include "definitions.h"
+
+static bool payeeKeyLess(const Payee &a, const Payee &b)
+{
+    return a.key < b.key;
+}
+
+static bool payeeRankMore(const Payee &a, const Payee &b)
+{
+    return a.count > b.count || (a.count == b.count && a.lastDate > b.lastDate);
+}
+
+/*
+ *  orders positions in the entry vector best ranked first
+ */
+struct PayeeRank
+{
+    const QVector<Payee> *payees;
+    bool operator()(int a, int b) const
+    {
+        return payeeRankMore(payees->at(a), payees->at(b));
+    }
+};
+
+PayeeIndex::PayeeIndex() :
+    ready(false)
+{
+    addNode(QString(), -1);
+}
+
+/*
+ *  reads the distinct comments on its own connection, so it can run on a worker thread.
+ *  the bare columns next to MAX() come from the most recent use of each comment. for a
+ *  transfer that may be either leg, so the leg's own account is kept with it
+ */
+QVector<Payee> PayeeIndex::loadEntries(const QString &databasePath)
+{
+    QVector<Payee> entries;
+    QString connectionName = QString("payeeindex_%1").arg(quintptr(QThread::currentThreadId()));
+    {
+        QSqlDatabase db = QSqlDatabase::addDatabase("QSQLITE", connectionName);
+        db.setDatabaseName(databasePath);
+        if (db.open())
+        {
+            QSqlQuery q(db);
+            q.setForwardOnly(true);
+            q.exec("SELECT t.comment, COUNT(*), MAX(t.date_trans), t.id_account, t.amount, r.id_account "
+                   "FROM trans t LEFT JOIN trans r ON t.id_relate = r.pk_uid "
+                   "WHERE t.comment IS NOT NULL AND t.comment <> '' GROUP BY t.comment");
+            entries = readEntries(q);
+            db.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(connectionName);
+    return entries;
+}
+
+/*
+ *  reads (comment, count, last date, account, amount, transfer account) rows into entries
+ *  sorted by key. comments differing only in case share one entry
+ */
+QVector<Payee> PayeeIndex::readEntries(QSqlQuery &q)
+{
+    QVector<Payee> entries;
+    while (q.next())
+    {
+        Payee p;
+        p.comment = q.value(0).toString();
+        p.key = p.comment.toLower();
+        p.count = q.value(1).toInt();
+        p.lastDate = QDate::fromJulianDay(q.value(2).toLongLong());
+        p.lastAccount = q.value(3).toInt();
+        p.lastAmount = q.value(4).toDouble();
+        p.lastTransferAccount = q.value(5).isNull() ? -1 : q.value(5).toInt();
+        entries.append(p);
+    }
+
+    std::sort(entries.begin(), entries.end(), payeeKeyLess);
+    QVector<Payee> merged;
+    for (int i = 0; i < entries.size(); ++i)
+    {
+        if (!merged.isEmpty() && merged.last().key == entries.at(i).key)
+        {
+            Payee &m = merged.last();
+            m.count += entries.at(i).count;
+            if (entries.at(i).lastDate > m.lastDate)
+            {
+                int count = m.count;
+                m = entries.at(i);
+                m.count = count;
+            }
+        }
+        else
+        {
+            merged.append(entries.at(i));
+        }
+    }
+    return merged;
+}
+
+/*
+ *  takes over the entries built in the background, builds the trie over them and
+ *  reloads the comments changed meanwhile
+ */
+void PayeeIndex::install(const QVector<Payee> &entries)
+{
+    payees = entries;
+    nodes.clear();
+    addNode(QString(), -1);
+    for (int i = 0; i < payees.size(); ++i)
+    {
+        int node = insertKey(payees.at(i).key);
+        nodes[node].payee = i;
+    }
+
+    //breadth first, then backwards, so every node ranks from finished child lists
+    QVector<int> order;
+    order.append(0);
+    for (int i = 0; i < order.size(); ++i)
+    {
+        order += nodes.at(order.at(i)).children;
+    }
+    for (int i = order.size() - 1; i > 0; --i)
+    {
+        rank(order.at(i));
+    }
+
+    ready = true;
+    QStringList changed = pending;
+    pending.clear();
+    reload(changed);
+}
+
+bool PayeeIndex::isReady() const
+{
+    return ready;
+}
+
+/*
+ *  reads the uses of the given comments again after rows with them were added, changed,
+ *  deleted, undone or redone. the account join lets each comment be found through the
+ *  (id_account, comment) index. a comment no longer used drops out of the lookups
+ */
+void PayeeIndex::reload(const QStringList &comments)
+{
+    if (!ready)
+    {
+        pending += comments;
+        return;
+    }
+
+    QSqlQuery q;
+    q.setForwardOnly(true);
+    q.prepare("SELECT t.comment, COUNT(*), MAX(t.date_trans), t.id_account, t.amount, r.id_account "
+              "FROM account a CROSS JOIN trans t ON t.id_account = a.pk_uid LEFT JOIN trans r ON t.id_relate = r.pk_uid "
+              "WHERE t.comment = ? COLLATE NOCASE GROUP BY t.comment");
+    for (int i = 0; i < comments.size(); ++i)
+    {
+        if (comments.at(i).isEmpty()) continue;
+
+        Payee p;
+        p.key = comments.at(i).toLower();
+        p.comment = comments.at(i);
+        p.count = 0;
+        p.lastAccount = -1;
+        p.lastAmount = 0;
+        p.lastTransferAccount = -1;
+        q.bindValue(0, comments.at(i));
+        q.exec();
+        QVector<Payee> entries = readEntries(q);
+        for (int j = 0; j < entries.size(); ++j)
+        {
+            if (entries.at(j).key == p.key) p = entries.at(j);
+        }
+
+        int node = findKey(p.key, false);
+        if (node < 0 || nodes.at(node).payee < 0)
+        {
+            if (p.count == 0) continue;
+            node = insertKey(p.key);
+            nodes[node].payee = payees.size();
+            payees.append(p);
+        }
+        else
+        {
+            payees[nodes.at(node).payee] = p;
+        }
+        rankPath(node);
+    }
+}
+
+/*
+ *  returns up to limit comments starting with prefix, most used first. the lists kept in
+ *  the trie hold payeeLookupRows entries, which caps limit
+ */
+QStringList PayeeIndex::lookup(const QString &prefix, int limit) const
+{
+    QStringList result;
+    if (prefix.isEmpty()) return result;
+
+    int node = findKey(prefix.toLower(), true);
+    if (node < 0) return result;
+
+    const QVector<int> &top = nodes.at(node).top;
+    for (int i = 0; i < top.size() && i < limit; ++i)
+    {
+        result.append(payees.at(top.at(i)).comment);
+    }
+    return result;
+}
+
+/*
+ *  returns the entry for a comment still in use, or 0
+ */
+const Payee *PayeeIndex::find(const QString &comment) const
+{
+    int node = findKey(comment.toLower(), false);
+    if (node < 0 || nodes.at(node).payee < 0 || payees.at(nodes.at(node).payee).count == 0)
+    {
+        return 0;
+    }
+    return &payees.at(nodes.at(node).payee);
+}
+
+/*
+ *  returns the node a key ends at, splitting a label or adding a node where the key
+ *  leaves the trie
+ */
+int PayeeIndex::insertKey(const QString &key)
+{
+    int node = 0;
+    int i = 0;
+    while (i < key.size())
+    {
+        int next = child(node, key.at(i));
+        if (next < 0)
+        {
+            return addNode(key.mid(i), node);
+        }
+
+        QString label = nodes.at(next).label;
+        int common = 1;
+        while (common < label.size() && i + common < key.size() && label.at(common) == key.at(i + common)) ++common;
+        if (common < label.size())
+        {
+            //the shared part of the label becomes a node of its own above next
+            int middle = addNode(label.left(common), node);
+            nodes[node].children.removeOne(next);
+            nodes[middle].children.append(next);
+            nodes[middle].top = nodes.at(next).top;
+            nodes[next].parent = middle;
+            nodes[next].label = label.mid(common);
+            next = middle;
+        }
+        node = next;
+        i += common;
+    }
+    return node;
+}
+
+/*
+ *  returns the node a key ends at, or -1. with partial the key may also end inside a
+ *  node's label, which then stands for every key going on past it
+ */
+int PayeeIndex::findKey(const QString &key, bool partial) const
+{
+    int node = 0;
+    int i = 0;
+    while (i < key.size())
+    {
+        node = child(node, key.at(i));
+        if (node < 0) return -1;
+
+        const QString &label = nodes.at(node).label;
+        int common = 1;
+        while (common < label.size() && i + common < key.size() && label.at(common) == key.at(i + common)) ++common;
+        if (common < label.size())
+        {
+            return (partial && i + common == key.size()) ? node : -1;
+        }
+        i += common;
+    }
+    return node;
+}
+
+/*
+ *  the child of a node whose label starts with first, or -1
+ */
+int PayeeIndex::child(int node, QChar first) const
+{
+    const QVector<int> &children = nodes.at(node).children;
+    for (int i = 0; i < children.size(); ++i)
+    {
+        if (nodes.at(children.at(i)).label.at(0) == first) return children.at(i);
+    }
+    return -1;
+}
+
+int PayeeIndex::addNode(const QString &label, int parent)
+{
+    Node n;
+    n.label = label;
+    n.parent = parent;
+    n.payee = -1;
+    nodes.append(n);
+    if (parent >= 0)
+    {
+        nodes[parent].children.append(nodes.size() - 1);
+    }
+    return nodes.size() - 1;
+}
+
+/*
+ *  rebuilds a node's list from its own entry and its children's lists
+ */
+void PayeeIndex::rank(int node)
+{
+    QVector<int> candidates;
+    const Node &n = nodes.at(node);
+    if (n.payee >= 0 && payees.at(n.payee).count > 0)
+    {
+        candidates.append(n.payee);
+    }
+    for (int i = 0; i < n.children.size(); ++i)
+    {
+        candidates += nodes.at(n.children.at(i)).top;
+    }
+
+    PayeeRank order;
+    order.payees = &payees;
+    int count = qMin(int(payeeLookupRows), candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(), order);
+    candidates.resize(count);
+    nodes[node].top = candidates;
+}
+
+/*
+ *  reranks a node and everything above it after its entry changed
+ */
+void PayeeIndex::rankPath(int node)
+{
+    for (int n = node; n > 0; n = nodes.at(n).parent)
+    {
+        rank(n);
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef PAYEEINDEX_H
+#define PAYEEINDEX_H
+
+#include <QDate>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class QSqlQuery;
+
+/*
+ *  one distinct comment with how often it was used and what it was last used with
+ */
+struct Payee
+{
+    QString key;            //lowercased comment, the trie key
+    QString comment;
+    int count;
+    QDate lastDate;
+    int lastAccount;            //account of the last use; the amount and transfer account are as seen from it
+    double lastAmount;
+    int lastTransferAccount;    //-1 when it was last used without a transfer
+};
+
+/*
+ *  prefix index over distinct trans comments: a compressed trie over the lowercased text
+ *  where every node keeps the best ranked entries below it, so a lookup only walks the
+ *  prefix. entries are ranked by use count, then by last use
+ */
+class PayeeIndex
+{
+public:
+    PayeeIndex();
+    static QVector<Payee> loadEntries(const QString &databasePath);
+    void install(const QVector<Payee> &entries);
+    bool isReady() const;
+    void reload(const QStringList &comments);
+    QStringList lookup(const QString &prefix, int limit) const;
+    const Payee *find(const QString &comment) const;
+
+private:
+    struct Node
+    {
+        QString label;          //the key text between the parent and this node
+        int parent;
+        QVector<int> children;
+        int payee;              //entry whose key ends here, -1 if none
+        QVector<int> top;       //best ranked entries at or below this node, at most payeeLookupRows
+    };
+
+    QVector<Payee> payees;      //positions never change, the trie refers to them
+    QVector<Node> nodes;        //nodes[0] is the root
+    QStringList pending;        //comments changed before the background load finished
+    bool ready;
+    static QVector<Payee> readEntries(QSqlQuery &q);
+    int insertKey(const QString &key);
+    int findKey(const QString &key, bool partial) const;
+    int child(int node, QChar first) const;
+    int addNode(const QString &label, int parent);
+    void rank(int node);
+    void rankPath(int node);
+};
+
+#endif // PAYEEINDEX_H
@@ -0,0 +1,139 @@
+#include <QtSql>
+#include <QQueue>
+#include <algorithm>
+#include "rulematcher.h"
+
+RuleMatcher::RuleMatcher()
+{
+}
+
+/*
+ *  reads the rule table and compiles the automaton
+ */
+bool RuleMatcher::load()
+{
+    rules.clear();
+    nodes.clear();
+    nodes.append(Node());
+    nodes[0].fail = 0;
+
+    QSqlQuery q;
+    q.setForwardOnly(true);
+    if (!q.exec("SELECT pk_uid, pattern, amount_min, amount_max, id_account FROM rule ORDER BY pk_uid")) return false;
+    while (q.next())
+    {
+        QString pattern = q.value(1).toString().trimmed().toLower();
+        if (pattern.isEmpty()) continue;
+
+        Rule r;
+        r.pk_uid = q.value(0).toInt();
+        r.hasMin = !q.value(2).isNull();
+        r.amountMin = q.value(2).toDouble();
+        r.hasMax = !q.value(3).isNull();
+        r.amountMax = q.value(3).toDouble();
+        r.id_account = q.value(4).toInt();
+        rules.append(r);
+        addPattern(pattern, rules.size() - 1);
+    }
+    build();
+    return true;
+}
+
+bool RuleMatcher::isEmpty() const
+{
+    return rules.isEmpty();
+}
+
+/*
+ *  returns the target account of the first rule whose pattern occurs in the comment
+ *  and whose amount range holds the amount, or -1
+ */
+int RuleMatcher::match(const QString &comment, double amount) const
+{
+    if (rules.isEmpty()) return -1;
+
+    QString text = comment.toLower();
+    int best = rules.size();
+    int state = 0;
+    for (int i = 0; i < text.length(); ++i)
+    {
+        ushort c = text.at(i).unicode();
+        while (state != 0 && !nodes.at(state).next.contains(c))
+        {
+            state = nodes.at(state).fail;
+        }
+        state = nodes.at(state).next.value(c, 0);
+
+        const QVector<int> &outputs = nodes.at(state).outputs;
+        for (int j = 0; j < outputs.size() && outputs.at(j) < best; ++j)
+        {
+            const Rule &r = rules.at(outputs.at(j));
+            if ((!r.hasMin || amount >= r.amountMin) && (!r.hasMax || amount <= r.amountMax))
+            {
+                best = outputs.at(j);
+                break;
+            }
+        }
+        if (best == 0) break;   //nothing can beat the first rule
+    }
+    return best < rules.size() ? rules.at(best).id_account : -1;
+}
+
+void RuleMatcher::addPattern(const QString &pattern, int rule)
+{
+    int state = 0;
+    for (int i = 0; i < pattern.length(); ++i)
+    {
+        ushort c = pattern.at(i).unicode();
+        int next = nodes.at(state).next.value(c, -1);
+        if (next < 0)
+        {
+            next = nodes.size();
+            nodes.append(Node());
+            nodes[state].next.insert(c, next);
+        }
+        state = next;
+    }
+    nodes[state].outputs.append(rule);
+}
+
+/*
+ *  breadth-first pass setting the failure links and folding each node's
+ *  failure outputs into its own
+ */
+void RuleMatcher::build()
+{
+    QQueue<int> queue;
+    QHash<ushort,int>::const_iterator i;
+
+    for (i = nodes.at(0).next.constBegin(); i != nodes.at(0).next.constEnd(); ++i)
+    {
+        nodes[i.value()].fail = 0;
+        queue.enqueue(i.value());
+    }
+
+    while (!queue.isEmpty())
+    {
+        int state = queue.dequeue();
+        QHash<ushort,int> next = nodes.at(state).next;
+        for (i = next.constBegin(); i != next.constEnd(); ++i)
+        {
+            int child = i.value();
+            int f = nodes.at(state).fail;
+            while (f != 0 && !nodes.at(f).next.contains(i.key()))
+            {
+                f = nodes.at(f).fail;
+            }
+            int target = nodes.at(f).next.value(i.key(), 0);
+            nodes[child].fail = (target == child) ? 0 : target;
+            queue.enqueue(child);
+        }
+
+        //the failure node is closer to the root, so it is already complete
+        if (state != 0)
+        {
+            nodes[state].outputs += nodes.at(nodes.at(state).fail).outputs;
+            std::sort(nodes[state].outputs.begin(), nodes[state].outputs.end());
+        }
+    }
+}
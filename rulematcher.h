@@ -0,0 +1,45 @@
+#ifndef RULEMATCHER_H
+#define RULEMATCHER_H
+
+#include <QHash>
+#include <QString>
+#include <QVector>
+
+/*
+ *  categorization rules compiled into one aho-corasick automaton over the lowercased
+ *  comment patterns, so a comment is scanned once no matter how many rules exist.
+ *  when several rules match, the one with the lowest pk_uid wins
+ */
+class RuleMatcher
+{
+public:
+    RuleMatcher();
+    bool load();
+    bool isEmpty() const;
+    int match(const QString &comment, double amount) const;
+
+private:
+    struct Rule
+    {
+        int pk_uid;
+        bool hasMin;
+        double amountMin;
+        bool hasMax;
+        double amountMax;
+        int id_account;
+    };
+
+    struct Node
+    {
+        QHash<ushort,int> next;
+        int fail;
+        QVector<int> outputs;   //rules ending here or at any suffix, sorted by priority
+    };
+
+    QVector<Rule> rules;
+    QVector<Node> nodes;
+    void addPattern(const QString &pattern, int rule);
+    void build();
+};
+
+#endif // RULEMATCHER_H
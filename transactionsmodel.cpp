@@ -1,195 +1,1992 @@
 #include <QtSql>
 #include <QLocale>
+#include <algorithm>
 #include "transactionsmodel.h"
 #include "definitions.h"
 
 TransactionsModel::TransactionsModel(QObject *parent) :
-    QSqlQueryModel(parent)
+    QAbstractTableModel(parent),
+    operationDepth(0),
+    operationFailed(false),
+    lastInsertId(-1),
+    currentAccount(-1),
+    atStart(true),
+    atEnd(true),
+    stale(true),
+    loadAll(false),
+    hasSplitLines(false),
+    closingTotal(0)
 {
 }
 
 Qt::ItemFlags TransactionsModel::flags(const QModelIndex &index) const
 {
-    Qt::ItemFlags flags = QSqlQueryModel::flags(index);
+    Qt::ItemFlags flags = QAbstractTableModel::flags(index);
+    if (!index.isValid())
+    {
+        return flags;
+    }
+    if (rows.at(index.row()).at(col_pk_uid).toInt() < 0)
+    {
+        return flags;  //a split line is edited through its parent
+    }
     if (index.column() == col_date  //identify editable columns
             || index.column() == col_comment
             || index.column() == col_amount)
     {
-        flags |= Qt::ItemIsEditable;  //set columns as editable
+        flags |= Qt::ItemIsEditable;  //set columns as editable
+    }
+    if (index.column() == col_amount && isSplit(rows.at(index.row()).at(col_pk_uid).toInt()))
+    {
+        flags &= ~Qt::ItemIsEditable;  //the amount of a split is the sum of its lines
+    }
+    return flags;
+}
+
+bool TransactionsModel::setData(const QModelIndex &index, const QVariant &value, int /*role*/)
+{
+    if (       index.column() == col_pk_uid
+            || index.column() == col_id_account
+            || index.column() == col_relate_account
+            || index.column() == col_total
+            || index.column() == col_reconciled)
+    {
+        return false;
+    }
+    int pk_uid = rows.at(index.row()).at(col_pk_uid).toInt();
+
+    bool success;
+    if (index.column() == col_date) {
+        success = setDate(pk_uid,value.toDate());
+    }
+    else if (index.column() == col_comment) {
+        success = setComment(pk_uid,value.toString());
+    }
+    else if (index.column() == col_amount) {
+        double amt;
+        amt = value.toFloat();
+        success = setAmount(pk_uid,amt);
+    }
+    else {
+        success = false;
+    }
+    refresh();
+    return success;
+}
+
+/*
+ *  shows the transactions of one account. ledger rows are only read when they belong to
+ *  the account and fall inside the date range; the index on (id_account, date_trans, pk_uid)
+ *  turns that into a range scan
+ */
+void TransactionsModel::setAccount(int accountId)
+{
+    currentAccount = accountId;
+    stale = true;
+}
+
+/*
+ *  limits the shown transactions to a date range. an invalid date leaves that end open
+ */
+void TransactionsModel::setDateRange(const QDate &from, const QDate &to)
+{
+    fromDate = from;
+    toDate = to;
+    stale = true;
+}
+
+/*
+ *  orders the shown rows by the given columns, most significant first. an empty list is
+ *  date order. pk_uid always breaks ties so every sort has a unique key the indexes on
+ *  (id_account, <column>, pk_uid) can walk
+ */
+void TransactionsModel::setSortKeys(const QList<QPair<int,Qt::SortOrder> > &keys)
+{
+    sortKeys.clear();
+    for (int i = 0; i < keys.size(); ++i)
+    {
+        if (isSortable(keys.at(i).first)) sortKeys.append(keys.at(i));
+    }
+    stale = true;
+}
+
+bool TransactionsModel::isSortable(int column)
+{
+    return column == col_date || column == col_comment || column == col_amount;
+}
+
+/*
+ *  whether the rows are shown in the order the running totals add up in, either way round
+ */
+bool TransactionsModel::isChronological() const
+{
+    return sortKeys.isEmpty() || (sortKeys.size() == 1 && sortKeys.first().first == col_date);
+}
+
+/*
+ *  the columns of the sort keys, most significant first, ending in pk_uid so every row
+ *  has a unique key
+ */
+QList<int> TransactionsModel::keyColumns() const
+{
+    QList<int> columns;
+    for (int i = 0; i < sortKeys.size(); ++i)
+    {
+        columns.append(sortKeys.at(i).first);
+    }
+    if (sortKeys.isEmpty())
+    {
+        columns.append(col_date);
+    }
+    columns.append(col_pk_uid);
+    return columns;
+}
+
+/*
+ *  the sort keys as expressions on the alias t, one per keyColumns()
+ */
+QStringList TransactionsModel::keyTerms() const
+{
+    QList<int> columns = keyColumns();
+    QStringList terms;
+    for (int i = 0; i < columns.size(); ++i)
+    {
+        switch (columns.at(i))
+        {
+        case col_date:
+            terms.append("t.date_trans");
+            break;
+        case col_comment:
+            terms.append("t.comment COLLATE NOCASE");
+            break;
+        case col_amount:
+            terms.append("t.amount");
+            break;
+        default:
+            terms.append("t.pk_uid");
+            break;
+        }
+    }
+    return terms;
+}
+
+/*
+ *  whether the key at the given position of keyTerms() runs descending. pk_uid runs the
+ *  way the first key does
+ */
+bool TransactionsModel::isDescending(int key) const
+{
+    if (sortKeys.isEmpty())
+    {
+        return false;
+    }
+    return sortKeys.at(key < sortKeys.size() ? key : 0).second == Qt::DescendingOrder;
+}
+
+QString TransactionsModel::orderBy(bool reversed) const
+{
+    QStringList terms = keyTerms();
+    for (int i = 0; i < terms.size(); ++i)
+    {
+        if (isDescending(i) != reversed) terms[i].append(" DESC");
+    }
+    return terms.join(", ");
+}
+
+/*
+ *  reads the sort key values of a shown row, one per keyTerms(). returns false when the
+ *  row isn't shown
+ */
+bool TransactionsModel::keyValues(int pk_uid, QVariantList &values) const
+{
+    QSqlQuery q;
+    q.prepare("SELECT " + keyTerms().join(", ") + " FROM " + rowSource() + " WHERE t.pk_uid = :pk_uid AND t.id_account = :account" + dateFilter("t"));
+    q.bindValue(":pk_uid", pk_uid);
+    bindDateRange(q);
+    if (!q.exec() || !q.first())
+    {
+        return false;
+    }
+    values.clear();
+    for (int i = 0; i < q.record().count(); ++i)
+    {
+        values.append(q.value(i));
+    }
+    return true;
+}
+
+/*
+ *  a keyset condition for the rows after the given key values in the shown order, or
+ *  before them when backward, as an extra WHERE condition. the row with those values
+ *  passes too when inclusive. every comparison gets its own placeholder, which goes
+ *  into binds. comments may be NULL, which sqlite sorts first
+ */
+QString TransactionsModel::seekFilter(const QVariantList &values, bool backward, bool inclusive, QVariantMap &binds) const
+{
+    QStringList terms = keyTerms();
+    QStringList levels;
+    for (int i = 0; i < terms.size(); ++i)
+    {
+        QStringList level;
+        for (int j = 0; j <= i; ++j)
+        {
+            QString name = QString(":seek%1_%2").arg(i).arg(j);
+            bool nullable = terms.at(j).startsWith("t.comment");
+            if (j < i)
+            {
+                if (values.at(j).isNull())
+                {
+                    level.append(terms.at(j) + " IS NULL");
+                    continue;
+                }
+                level.append(terms.at(j) + " = " + name);
+            }
+            else if (values.at(j).isNull())
+            {
+                level.append(isDescending(j) != backward ? "0" : terms.at(j) + " IS NOT NULL");
+                continue;
+            }
+            else
+            {
+                QString compare = terms.at(j) + (isDescending(j) != backward ? " <" : " >") + (inclusive && i == terms.size() - 1 ? "= " : " ") + name;
+                if (nullable && isDescending(j) != backward)
+                {
+                    compare = "(" + compare + " OR " + terms.at(j) + " IS NULL)";
+                }
+                level.append(compare);
+            }
+            binds.insert(name, values.at(j));
+        }
+        levels.append("(" + level.join(" AND ") + ")");
+    }
+
+    //the same bound on the first key alone lets sqlite start the index scan at the row
+    QString bound;
+    bool descending = isDescending(0) != backward;
+    if (!values.first().isNull() && !(descending && terms.first().startsWith("t.comment")))
+    {
+        bound = " AND " + terms.first() + (descending ? " <= " : " >= ") + ":seek";
+        binds.insert(":seek", values.first());
+    }
+    return bound + " AND (" + levels.join(" OR ") + ")";
+}
+
+/*
+ *  shows the first rows of the order, the last ones, or the ones from a given row on. only
+ *  windowRows rows are read; the rest come a page at a time as the view scrolls to them
+ */
+void TransactionsModel::loadFirst(int windowRows)
+{
+    prepareRows();
+    QVector<Row> page = readPage(QVariantList(), false, false, windowRows);
+    showRows(page, true, page.size() < windowRows);
+}
+
+void TransactionsModel::loadLast(int windowRows)
+{
+    prepareRows();
+    QVector<Row> page = readPage(QVariantList(), true, false, windowRows);
+    showRows(page, page.size() < windowRows, true);
+}
+
+/*
+ *  returns false, leaving the rows as they were, when anchorId isn't shown
+ */
+bool TransactionsModel::loadFrom(int anchorId, int windowRows)
+{
+    prepareRows();
+    QVariantList anchor;
+    if (!keyValues(anchorId, anchor))
+    {
+        return false;
+    }
+    QVector<Row> page = readPage(anchor, false, true, windowRows);
+    showRows(page, false, page.size() < windowRows);
+    return true;
+}
+
+/*
+ *  reads the loaded rows again after a change, keeping the same stretch of the order: the
+ *  last rows when the end was loaded, else the first rows or the ones from the first loaded
+ *  row on. after the account, date range or sort changed it shows the last page instead
+ */
+void TransactionsModel::refresh()
+{
+    if (stale || rows.isEmpty())
+    {
+        loadLast(transactionPageRows);
+        return;
+    }
+
+    int count = qMax(rows.size(), transactionPageRows);
+    QVariantList first = keysOf(rows.first());
+    prepareRows();
+    QVector<Row> page;
+    if (atEnd)
+    {
+        page = readPage(QVariantList(), true, false, count);
+        showRows(page, page.size() < count, true);
+    }
+    else
+    {
+        page = readPage(atStart ? QVariantList() : first, false, true, count);
+        showRows(page, atStart, page.size() < count);
+    }
+}
+
+/*
+ *  while the view filters the rows every load reads all of them, so the filter and the
+ *  sum of what it shows cover the whole range
+ */
+void TransactionsModel::setLoadAll(bool all)
+{
+    loadAll = all;
+    if (loadAll)
+    {
+        fetchAll();
+    }
+}
+
+void TransactionsModel::fetchAll()
+{
+    while (canFetchPrevious())
+    {
+        fetchPrevious();
+    }
+    while (canFetchMore(QModelIndex()))
+    {
+        fetchMore(QModelIndex());
+    }
+}
+
+bool TransactionsModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && !atEnd;
+}
+
+/*
+ *  reads the page after the last loaded row, seeking on its sort key values
+ */
+void TransactionsModel::fetchMore(const QModelIndex &parent)
+{
+    if (!canFetchMore(parent))
+    {
+        return;
+    }
+    QVector<Row> page = readPage(rows.isEmpty() ? QVariantList() : keysOf(rows.last()), false, false, transactionPageRows);
+    atEnd = page.size() < transactionPageRows;
+    if (page.isEmpty())
+    {
+        return;
+    }
+    placeTotals(page, true);
+    loadSplits(page);
+    beginInsertRows(QModelIndex(), rows.size(), rows.size() + page.size() - 1);
+    rows += page;
+    endInsertRows();
+}
+
+bool TransactionsModel::canFetchPrevious() const
+{
+    return !atStart;
+}
+
+/*
+ *  reads the page before the first loaded row. views only fetch at the end, so the
+ *  window calls this when the view is scrolled to the top
+ */
+void TransactionsModel::fetchPrevious()
+{
+    if (!canFetchPrevious())
+    {
+        return;
+    }
+    QVector<Row> page = readPage(rows.isEmpty() ? QVariantList() : keysOf(rows.first()), true, false, transactionPageRows);
+    atStart = page.size() < transactionPageRows;
+    if (page.isEmpty())
+    {
+        return;
+    }
+    placeTotals(page, false);
+    loadSplits(page);
+    beginInsertRows(QModelIndex(), 0, page.size() - 1);
+    rows = page + rows;
+    endInsertRows();
+}
+
+/*
+ *  settles what the next read of the shown rows needs: whether split lines are listed,
+ *  the running total at the end of the range and the account names for split tooltips
+ */
+void TransactionsModel::prepareRows()
+{
+    QSqlQuery q;
+    q.prepare("SELECT 1 FROM trans_split WHERE id_account = ? LIMIT 1");
+    q.addBindValue(currentAccount);
+    hasSplitLines = q.exec() && q.first();
+    closingTotal = closingBalance();
+
+    accountNames.clear();
+    QSqlQuery names;
+    names.setForwardOnly(true);
+    names.exec("SELECT pk_uid, account_name FROM account");
+    while (names.next())
+    {
+        accountNames.insert(names.value(0).toInt(), names.value(1).toString());
+    }
+}
+
+/*
+ *  replaces the loaded rows with a page that has no loaded neighbours
+ */
+void TransactionsModel::showRows(QVector<Row> &page, bool first, bool last)
+{
+    if (!page.isEmpty())
+    {
+        spanTotals(page);
+    }
+    beginResetModel();
+    rows.clear();
+    splitCache.clear();
+    loadSplits(page);
+    rows = page;
+    atStart = first;
+    atEnd = last;
+    stale = false;
+    endResetModel();
+    if (loadAll)
+    {
+        fetchAll();
+    }
+}
+
+/*
+ *  reads up to limit rows after the given sort key values in the shown order, or before
+ *  them when backward, and returns them in the shown order. with no key values it reads
+ *  from the start, or from the end when backward
+ */
+QVector<TransactionsModel::Row> TransactionsModel::readPage(const QVariantList &keys, bool backward, bool inclusive, int limit) const
+{
+    QVariantMap binds;
+    QSqlQuery q;
+    q.setForwardOnly(true);
+    q.prepare(selectRows() + (keys.isEmpty() ? QString() : seekFilter(keys, backward, inclusive, binds)) +
+              " ORDER BY " + orderBy(backward) + " LIMIT " + QString::number(limit));
+    bindDateRange(q);
+    bindValues(q, binds);
+    q.exec();
+
+    QVector<Row> page;
+    while (q.next())
+    {
+        Row row(col_count);
+        for (int i = 0; i < col_count; ++i)
+        {
+            row[i] = q.value(i);
+        }
+        page.append(row);
+    }
+    if (backward)
+    {
+        std::reverse(page.begin(), page.end());
+    }
+    return page;
+}
+
+QVariantList TransactionsModel::keysOf(const Row &row) const
+{
+    QList<int> columns = keyColumns();
+    QVariantList keys;
+    for (int i = 0; i < columns.size(); ++i)
+    {
+        keys.append(row.at(columns.at(i)));
+    }
+    return keys;
+}
+
+/*
+ *  fills in the running totals of a page read next to the loaded rows: after them when
+ *  appended, before them otherwise. in date order each total follows from its neighbour's.
+ *  sorted any other way, or with no loaded rows to follow from, they come from spanTotals()
+ */
+void TransactionsModel::placeTotals(QVector<Row> &page, bool appended) const
+{
+    if (page.isEmpty())
+    {
+        return;
+    }
+    if (!isChronological() || rows.isEmpty())
+    {
+        spanTotals(page);
+        return;
+    }
+
+    bool forward = !isDescending(0);    //later rows are shown further down
+    if (appended)
+    {
+        for (int i = 0; i < page.size(); ++i)
+        {
+            const Row &previous = (i == 0) ? rows.last() : page.at(i - 1);
+            double total = forward ? previous.at(col_total).toDouble() + page.at(i).at(col_amount).toDouble()
+                                   : previous.at(col_total).toDouble() - previous.at(col_amount).toDouble();
+            page[i][col_total] = total;
+        }
+    }
+    else
+    {
+        for (int i = page.size() - 1; i >= 0; --i)
+        {
+            const Row &next = (i == page.size() - 1) ? rows.first() : page.at(i + 1);
+            double total = forward ? next.at(col_total).toDouble() - next.at(col_amount).toDouble()
+                                   : next.at(col_total).toDouble() + page.at(i).at(col_amount).toDouble();
+            page[i][col_total] = total;
+        }
+    }
+}
+
+/*
+ *  running totals of a page from its span in date order: the latest row's total is the
+ *  closing balance less what comes after it, and the span is walked back from there to
+ *  the earliest row. in date order the span is the page itself
+ */
+void TransactionsModel::spanTotals(QVector<Row> &page) const
+{
+    int earliest = 0;
+    int latest = 0;
+    QHash<int,int> positions;    //pk_uid -> row of the page
+    for (int i = 0; i < page.size(); ++i)
+    {
+        positions.insert(page.at(i).at(col_pk_uid).toInt(), i);
+        if (isLater(page.at(i), page.at(latest))) latest = i;
+        if (isLater(page.at(earliest), page.at(i))) earliest = i;
+    }
+
+    QVariantMap binds;
+    QSqlQuery sum;
+    sum.prepare("SELECT COALESCE(SUM(t.amount), 0) FROM " + rowSource() + " WHERE t.id_account = :account" + dateFilter("t") +
+                dateSeek(page.at(latest), false, false, ":after", binds));
+    bindDateRange(sum);
+    bindValues(sum, binds);
+    sum.exec();
+    double total = closingTotal - (sum.first() ? sum.value(0).toDouble() : 0);
+
+    binds.clear();
+    QSqlQuery q;
+    q.setForwardOnly(true);
+    q.prepare("SELECT t.pk_uid, t.amount FROM " + rowSource() + " WHERE t.id_account = :account" + dateFilter("t") +
+              dateSeek(page.at(latest), true, true, ":latest", binds) + dateSeek(page.at(earliest), false, true, ":earliest", binds) +
+              " ORDER BY t.date_trans DESC, t.pk_uid DESC");
+    bindDateRange(q);
+    bindValues(q, binds);
+    q.exec();
+    while (q.next())
+    {
+        QHash<int,int>::const_iterator i = positions.constFind(q.value(0).toInt());
+        if (i != positions.constEnd())
+        {
+            page[i.value()][col_total] = total;
+        }
+        total -= q.value(1).toDouble();
+    }
+}
+
+/*
+ *  a condition for the rows after the given row in date order, or before it when
+ *  earlier. the row itself passes too when inclusive. placeholders start with name
+ */
+QString TransactionsModel::dateSeek(const Row &row, bool earlier, bool inclusive, const QString &name, QVariantMap &binds) const
+{
+    QString strict = earlier ? " < " : " > ";
+    QString loose = earlier ? " <= " : " >= ";
+    binds.insert(name + "_bound", row.at(col_date));
+    binds.insert(name + "_date", row.at(col_date));
+    binds.insert(name + "_day", row.at(col_date));
+    binds.insert(name + "_pk", row.at(col_pk_uid));
+    return " AND t.date_trans" + loose + name + "_bound AND (t.date_trans" + strict + name + "_date OR (t.date_trans = " + name + "_day AND t.pk_uid" +
+            (inclusive ? loose : strict) + name + "_pk))";
+}
+
+bool TransactionsModel::isLater(const Row &row, const Row &other)
+{
+    qlonglong date = row.at(col_date).toLongLong();
+    qlonglong otherDate = other.at(col_date).toLongLong();
+    return date > otherDate || (date == otherDate && row.at(col_pk_uid).toInt() > other.at(col_pk_uid).toInt());
+}
+
+/*
+ *  the query of the shown rows without its ORDER BY. the totals are filled in per page
+ */
+QString TransactionsModel::selectRows() const
+{
+    return "SELECT t.pk_uid, t.id_account, a.account_name AS relate_account, t.date_trans, t.comment, t.amount, NULL AS total, t.reconciled, o.currency "
+           "FROM " + rowSource() + " LEFT JOIN trans r ON t.id_relate = r.pk_uid "
+           "LEFT JOIN account a ON r.id_account = a.pk_uid "
+           "LEFT JOIN account o ON t.id_account = o.pk_uid "
+           "WHERE t.id_account = :account" + dateFilter("t");
+}
+
+int TransactionsModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : rows.size();
+}
+
+int TransactionsModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : col_count;
+}
+
+QVariant TransactionsModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+    {
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+    switch (section)
+    {
+    case col_pk_uid:
+        return QObject::tr("pk_uid");
+    case col_id_account:
+        return QObject::tr("id_account");
+    case col_relate_account:
+        return QObject::tr("relate_account");
+    case col_date:
+        return QObject::tr("Date");
+    case col_comment:
+        return QObject::tr("Comment");
+    case col_amount:
+        return QObject::tr("Amount");
+    case col_total:
+        return QObject::tr("Total");
+    case col_reconciled:
+        return QObject::tr("Reconciled");
+    case col_currency:
+        return QObject::tr("Currency");
+    }
+    return QVariant();
+}
+
+/*
+ *  the rows of the shown account as a source aliased t. an account that split lines point
+ *  at also lists those lines, like the mirror leg of a transfer: negated, dated and related
+ *  to their parent and keyed by their negative pk_uid so they can't be taken for trans rows.
+ *  the account filter reaches into both halves of the union, so each still reads its index
+ */
+QString TransactionsModel::rowSource() const
+{
+    if (!hasSplitLines)
+    {
+        return "trans t";
+    }
+    return "(SELECT pk_uid, id_account, date_trans, amount, comment, id_relate, reconciled FROM trans "
+           "UNION ALL SELECT -s.pk_uid, s.id_account, p.date_trans, -s.amount, COALESCE(NULLIF(s.comment, ''), p.comment), s.id_trans, p.reconciled "
+           "FROM trans_split s JOIN trans p ON p.pk_uid = s.id_trans) t";
+}
+
+/*
+ *  the running total of the account after the last shown row: the balance cache less the
+ *  rows and split lines dated after the range
+ */
+double TransactionsModel::closingBalance() const
+{
+    QSqlQuery q;
+    if (!toDate.isValid())
+    {
+        q.prepare("SELECT balance FROM account_balance WHERE id_account = ?");
+        q.addBindValue(currentAccount);
+    }
+    else
+    {
+        q.prepare("SELECT COALESCE((SELECT balance FROM account_balance WHERE id_account = ?), 0) "
+                  "- (SELECT COALESCE(SUM(t.amount), 0) FROM " + rowSource() + " WHERE t.id_account = ? AND t.date_trans > ?)");
+        q.addBindValue(currentAccount);
+        q.addBindValue(currentAccount);
+        q.addBindValue(toDate.toJulianDay());
+    }
+    if (q.exec() && q.first())
+    {
+        return q.value(0).toDouble();
+    }
+    return 0;
+}
+
+/*
+ *  the date range as extra WHERE conditions on the given trans alias
+ */
+QString TransactionsModel::dateFilter(const QString &alias) const
+{
+    QString filter;
+    if (fromDate.isValid()) filter.append(" AND " + alias + ".date_trans >= :from");
+    if (toDate.isValid()) filter.append(" AND " + alias + ".date_trans <= :to");
+    return filter;
+}
+
+void TransactionsModel::bindDateRange(QSqlQuery &q) const
+{
+    q.bindValue(":account", currentAccount);
+    if (fromDate.isValid()) q.bindValue(":from", fromDate.toJulianDay());
+    if (toDate.isValid()) q.bindValue(":to", toDate.toJulianDay());
+}
+
+void TransactionsModel::bindValues(QSqlQuery &q, const QVariantMap &binds)
+{
+    for (QVariantMap::const_iterator i = binds.constBegin(); i != binds.constEnd(); ++i)
+    {
+        q.bindValue(i.key(), i.value());
+    }
+}
+
+/*
+ *  caches the split lines of a page of rows as it is read so reads never join trans_split
+ */
+void TransactionsModel::loadSplits(const QVector<Row> &page)
+{
+    QList<int> ids;
+    for (int i = 0; i < page.size(); ++i)
+    {
+        if (page.at(i).at(col_pk_uid).toInt() > 0) ids.append(page.at(i).at(col_pk_uid).toInt());
+    }
+    if (ids.isEmpty())
+    {
+        return;
+    }
+
+    QSqlQuery q;
+    q.setForwardOnly(true);
+    q.exec("SELECT pk_uid, id_trans, id_account, comment, amount FROM trans_split "
+           "WHERE id_trans IN (" + idList(ids) + ") ORDER BY id_trans, pk_uid");
+    while (q.next())
+    {
+        SplitLine line;
+        line.pk_uid = q.value(0).toInt();
+        line.id_trans = q.value(1).toInt();
+        line.id_account = q.value(2).toInt();
+        line.comment = q.value(3).toString();
+        line.amount = q.value(4).toDouble();
+        splitCache[line.id_trans].append(line);
+    }
+}
+
+/*
+ *  creates the tables and indexes coin relies on beyond the base schema
+ */
+bool TransactionsModel::createSchema()
+{
+    QSqlQuery q;
+
+    //dates are stored as julian day numbers so ranges and ordering compare integers
+    QString dateType;
+    if (!q.exec("PRAGMA table_info(trans)")) return false;
+    while (q.next())
+    {
+        if (q.value(1).toString() == "date_trans") dateType = q.value(2).toString().toLower();
+    }
+    if (dateType != "integer" && !migrateDates()) return false;
+
+    if (!q.exec("CREATE INDEX IF NOT EXISTS trans_relate ON trans (id_relate)")) return false;
+    if (!q.exec("CREATE INDEX IF NOT EXISTS trans_account_date ON trans (id_account, date_trans, pk_uid)")) return false;
+    if (!q.exec("CREATE INDEX IF NOT EXISTS trans_account_amount ON trans (id_account, amount, pk_uid)")) return false;
+    if (!q.exec("CREATE INDEX IF NOT EXISTS trans_account_comment ON trans (id_account, comment COLLATE NOCASE, pk_uid)")) return false;
+
+    //account balances are maintained incrementally by the mutators below
+    if (!q.exec("CREATE TABLE IF NOT EXISTS account_balance (id_account integer PRIMARY KEY, balance real DEFAULT (0))")) return false;
+    if (!q.exec("SELECT COUNT(*) FROM account_balance") || !q.first()) return false;
+    bool seedBalances = (q.value(0).toInt() == 0);
+
+    //split lines live in their own table, keyed to the parent transaction
+    if (!q.exec("CREATE TABLE IF NOT EXISTS trans_split (pk_uid integer PRIMARY KEY, id_trans int, id_account int, comment text, amount real)")) return false;
+    if (!q.exec("CREATE INDEX IF NOT EXISTS trans_split_trans ON trans_split (id_trans)")) return false;
+    if (!q.exec("CREATE INDEX IF NOT EXISTS trans_split_account ON trans_split (id_account)")) return false;
+
+    //categorization rules: a comment pattern and optional amount range mapped to an account
+    if (!q.exec("CREATE TABLE IF NOT EXISTS rule (pk_uid integer PRIMARY KEY, pattern text, amount_min real, amount_max real, id_account int)")) return false;
+
+    //accounts carry an iso currency code, rates are kept per currency and date
+    bool hasCurrency = false;
+    if (!q.exec("PRAGMA table_info(account)")) return false;
+    while (q.next())
+    {
+        if (q.value(1).toString() == "currency") hasCurrency = true;
+    }
+    if (!hasCurrency)
+    {
+        if (!q.exec("ALTER TABLE account ADD COLUMN currency text DEFAULT ('" baseCurrency "')")) return false;
+    }
+    if (!q.exec("CREATE TABLE IF NOT EXISTS exchange_rate (currency text, date_rate text, rate real, PRIMARY KEY (currency, date_rate))")) return false;
+
+    //monthly budgets cover an account and everything below it. budget_month keeps what was
+    //spent per budget and month, maintained by the mutators like the balance cache
+    if (!q.exec("CREATE TABLE IF NOT EXISTS budget (pk_uid integer PRIMARY KEY, id_account int UNIQUE, planned real DEFAULT (0))")) return false;
+    if (!q.exec("CREATE TABLE IF NOT EXISTS budget_month (id_budget int, month int, spent real DEFAULT (0), PRIMARY KEY (id_budget, month))")) return false;
+
+    //the ledger scanner keeps a hash per row and rescans only the rows triggers mark as dirty.
+    //a new hash table starts with every row dirty
+    if (!q.exec("SELECT COUNT(*) FROM sqlite_master WHERE type = 'table' AND name = 'trans_hash'") || !q.first()) return false;
+    bool seedHashes = (q.value(0).toInt() == 0);
+    if (!q.exec("CREATE TABLE IF NOT EXISTS trans_hash (pk_uid integer PRIMARY KEY, hash int)")) return false;
+    if (!q.exec("CREATE INDEX IF NOT EXISTS trans_hash_hash ON trans_hash (hash)")) return false;
+    if (!q.exec("CREATE TABLE IF NOT EXISTS trans_dirty (pk_uid integer PRIMARY KEY)")) return false;
+    if (!q.exec("CREATE TRIGGER IF NOT EXISTS trans_dirty_insert AFTER INSERT ON trans "
+                "BEGIN INSERT OR IGNORE INTO trans_dirty (pk_uid) VALUES (NEW.pk_uid); END")) return false;
+    if (!q.exec("CREATE TRIGGER IF NOT EXISTS trans_dirty_update AFTER UPDATE OF pk_uid, id_account, date_trans, amount, comment, id_relate ON trans "
+                "BEGIN INSERT OR IGNORE INTO trans_dirty (pk_uid) VALUES (OLD.pk_uid); "
+                "INSERT OR IGNORE INTO trans_dirty (pk_uid) VALUES (NEW.pk_uid); END")) return false;
+    if (!q.exec("CREATE TRIGGER IF NOT EXISTS trans_dirty_delete AFTER DELETE ON trans "
+                "BEGIN INSERT OR IGNORE INTO trans_dirty (pk_uid) VALUES (OLD.pk_uid); END")) return false;
+    if (seedHashes && !q.exec("INSERT OR IGNORE INTO trans_dirty (pk_uid) SELECT pk_uid FROM trans")) return false;
+
+    if (seedBalances && !rebuildBalances()) return false;
+
+    return true;
+}
+
+/*
+ *  rebuilds trans with an integer date_trans holding julian day numbers (the same numbers
+ *  QDate::toJulianDay uses). sqlite can't change a column type in place, so the table is
+ *  copied and the trans_total view is recreated on top of it
+ */
+bool TransactionsModel::migrateDates()
+{
+    QSqlDatabase db = QSqlDatabase::database();
+    QSqlQuery q;
+
+    db.transaction();
+    if (!q.exec("DROP VIEW IF EXISTS trans_total")
+            || !q.exec("CREATE TABLE trans_new (pk_uid integer PRIMARY KEY, id_account int, date_trans integer, "
+                       "amount real, comment text, id_relate int, reconciled int DEFAULT (0))")
+            || !q.exec("INSERT INTO trans_new (pk_uid, id_account, date_trans, amount, comment, id_relate, reconciled) "
+                       "SELECT pk_uid, id_account, CAST(julianday(date_trans) + 0.5 AS INTEGER), amount, comment, id_relate, reconciled FROM trans")
+            || !q.exec("DROP TABLE trans")
+            || !q.exec("ALTER TABLE trans_new RENAME TO trans")
+            || !q.exec("CREATE VIEW trans_total AS "
+                       "SELECT trans_main.pk_uid, trans_main.id_account, account.account_name AS relate_account, "
+                       "trans_main.date_trans, trans_main.comment, trans_main.amount, "
+                       "SUM(trans_main.amount) OVER (PARTITION BY trans_main.id_account ORDER BY trans_main.date_trans, trans_main.pk_uid) AS total, "
+                       "trans_main.reconciled "
+                       "FROM trans trans_main LEFT JOIN trans trans_relate ON trans_main.id_relate = trans_relate.pk_uid "
+                       "LEFT JOIN account ON trans_relate.id_account = account.pk_uid")
+            || !db.commit())
+    {
+        db.rollback();
+        return false;
+    }
+    return true;
+}
+
+/*
+ *  recomputes the balance cache from scratch. the mutators keep it current, so this
+ *  is only needed after the ledger was changed outside of coin
+ */
+bool TransactionsModel::rebuildBalances()
+{
+    QSqlDatabase db = QSqlDatabase::database();
+    QSqlQuery q;
+
+    db.transaction();
+    if (!q.exec("DELETE FROM account_balance")
+            || !q.exec("INSERT INTO account_balance (id_account, balance) "
+                       "SELECT id_account, SUM(amount) FROM "
+                       "(SELECT id_account, amount FROM trans UNION ALL SELECT id_account, -amount FROM trans_split) "
+                       "GROUP BY id_account")
+            || !db.commit())
+    {
+        db.rollback();
+        return false;
+    }
+    return true;
+}
+
+/*
+ *  recomputes the monthly totals of one budget (or of all of them) from the ledger. this is
+ *  needed once when a budget is created and after rates or currencies change; otherwise the
+ *  mutators keep the totals current. the sums are taken per currency and converted into the
+ *  currency of the budget's account the same way applyBalanceDeltas converts them
+ */
+bool TransactionsModel::rebuildBudgets(int budgetId)
+{
+    QSqlDatabase db = QSqlDatabase::database();
+    QSqlQuery deleteQuery;
+    QSqlQuery sumQuery;
+    QSqlQuery insertQuery;
+    QString budgetFilter = budgetId < 0 ? QString() : QString(" WHERE pk_uid = %1").arg(budgetId);
+    ExchangeRates rates;
+
+    db.transaction();
+    deleteQuery.prepare(budgetId < 0 ? "DELETE FROM budget_month" : "DELETE FROM budget_month WHERE id_budget = ?");
+    if (budgetId >= 0) deleteQuery.addBindValue(budgetId);
+    sumQuery.setForwardOnly(true);
+    sumQuery.prepare("WITH RECURSIVE covered(id_budget, id_account) AS "
+                     "(SELECT pk_uid, id_account FROM budget" + budgetFilter +
+                     " UNION SELECT covered.id_budget, account.pk_uid FROM account JOIN covered ON account.id_parent = covered.id_account) "
+                     "SELECT covered.id_budget, COALESCE(CAST(strftime('%Y%m', ledger.date_trans) AS INTEGER), 0), "
+                     "COALESCE(NULLIF(leaf.currency, ''), '" baseCurrency "'), COALESCE(NULLIF(root.currency, ''), '" baseCurrency "'), SUM(ledger.amount) "
+                     "FROM covered JOIN "
+                     "(SELECT id_account, date_trans, amount FROM trans "
+                     "UNION ALL SELECT s.id_account, t.date_trans, -s.amount FROM trans_split s LEFT JOIN trans t ON t.pk_uid = s.id_trans) ledger "
+                     "ON ledger.id_account = covered.id_account "
+                     "JOIN account leaf ON leaf.pk_uid = covered.id_account "
+                     "JOIN budget ON budget.pk_uid = covered.id_budget "
+                     "JOIN account root ON root.pk_uid = budget.id_account GROUP BY 1, 2, 3, 4");
+    if (!rates.load() || !deleteQuery.exec() || !sumQuery.exec())
+    {
+        db.rollback();
+        return false;
+    }
+
+    QHash<QPair<int,int>,double> spent;
+    while (sumQuery.next())
+    {
+        int month = sumQuery.value(1).toInt();
+        spent[qMakePair(sumQuery.value(0).toInt(), month)] += rates.convert(sumQuery.value(4).toDouble(), sumQuery.value(2).toString(),
+                                                                           sumQuery.value(3).toString(), monthStart(month));
+    }
+
+    QVariantList budgets, months, totals;
+    QHash<QPair<int,int>,double>::const_iterator i;
+    for (i = spent.constBegin(); i != spent.constEnd(); ++i)
+    {
+        budgets << i.key().first;
+        months << i.key().second;
+        totals << i.value();
+    }
+    insertQuery.prepare("INSERT INTO budget_month (id_budget, month, spent) VALUES (?,?,?)");
+    insertQuery.addBindValue(budgets);
+    insertQuery.addBindValue(months);
+    insertQuery.addBindValue(totals);
+    if ((!budgets.isEmpty() && !insertQuery.execBatch()) || !db.commit())
+    {
+        db.rollback();
+        return false;
+    }
+    return true;
+}
+
+bool TransactionsModel::setDate(int pk_uid, const QDate &transactionDate)
+{
+    if (!transactionDate.isValid()) return false;
+
+    beginOperation(tr("Change date"));
+    return endOperation(updateField(pk_uid, JournalEntry::FieldDate, transactionDate.toJulianDay(), transactionDate.toJulianDay()));
+}
+
+bool TransactionsModel::setComment(int pk_uid, const QString &transactionComment)
+{
+    beginOperation(tr("Change comment"));
+    return endOperation(updateField(pk_uid, JournalEntry::FieldComment, transactionComment, transactionComment));
+}
+
+bool TransactionsModel::setAmount(int pk_uid, double &transactionAmount)
+{
+    double relatedAmount = -1 * transactionAmount;
+
+    //a transfer between currencies keeps each leg in its own account's currency
+    QVector<JournalRow> rows = fetchRows(pk_uid, true);
+    if (rows.size() == 2)
+    {
+        const JournalRow &own = rows.at(0).pk_uid == pk_uid ? rows.at(0) : rows.at(1);
+        const JournalRow &related = rows.at(0).pk_uid == pk_uid ? rows.at(1) : rows.at(0);
+        QDate date = QDate::fromJulianDay(own.date_trans.toLongLong());
+        relatedAmount = -1 * rates.convert(transactionAmount, accountCurrency(own.id_account), accountCurrency(related.id_account), date);
+    }
+
+    beginOperation(tr("Change amount"));
+    return endOperation(updateField(pk_uid, JournalEntry::FieldAmount, transactionAmount, relatedAmount));
+}
+
+bool TransactionsModel::setReconcile(int pk_uid, bool reconcileState)
+{
+    QSqlQuery q;
+
+    beginOperation(tr("Reconcile"));
+
+    QVector<JournalRow> rows = fetchRows(pk_uid, false);
+    for (int i = 0; i < rows.size(); ++i)
+    {
+        journal.recordChange(pk_uid, JournalEntry::FieldReconciled, rows.at(i).reconciled, reconcileState ? 1 : 0);
+    }
+
+    if(reconcileState)  //reconciled should be set to true
+    {
+        q.prepare("UPDATE trans SET reconciled = 1 WHERE pk_uid = ?");
+    }
+    else                //reconciled should be set to false
+    {
+        q.prepare("UPDATE trans SET reconciled = 0 WHERE pk_uid = ?");
+    }
+    q.addBindValue(pk_uid);
+    return endOperation(q.exec());
+}
+
+bool TransactionsModel::addTransaction(int &accountId, QDate &transactionDate,QString &transactionComment,double &transactionAmount)
+{
+    QSqlQuery q;
+
+    beginOperation(tr("Add transaction"));
+
+    q.prepare("INSERT INTO trans (id_account, date_trans, comment, amount, reconciled) VALUES (?,?,?,?,0)");
+    q.addBindValue(accountId);
+    q.addBindValue(transactionDate.toJulianDay());
+    q.addBindValue(transactionComment);
+    q.addBindValue(transactionAmount);
+    if (!q.exec()) return endOperation(false);
+    lastInsertId = q.lastInsertId().toInt();
+
+    JournalRow row;
+    row.pk_uid = lastInsertId;
+    row.id_account = accountId;
+    row.date_trans = transactionDate.toJulianDay();
+    row.comment = transactionComment;
+    row.amount = transactionAmount;
+    row.reconciled = 0;
+    journal.recordInsert(row);
+
+    LedgerDeltas deltas;
+    deltas.insert(qMakePair(accountId, monthOf(row.date_trans)), transactionAmount);
+    return endOperation(applyBalanceDeltas(deltas));
+}
+
+bool TransactionsModel::addTransactionRelation(int &transactionId, int &relateId)
+{
+    QSqlQuery q;
+
+    beginOperation(tr("Add transfer"));
+
+    QVector<JournalRow> rows = fetchRows(transactionId, false);
+    for (int i = 0; i < rows.size(); ++i)
+    {
+        journal.recordChange(transactionId, JournalEntry::FieldRelate, rows.at(i).id_relate, relateId);
+    }
+
+    q.prepare("UPDATE trans SET id_relate=? WHERE pk_uid=?");
+    q.addBindValue(relateId);
+    q.addBindValue(transactionId);
+    return endOperation(q.exec());
+}
+
+/*
+ *  makes a transfer leg an ordinary transaction again
+ */
+bool TransactionsModel::clearTransactionRelation(int &transactionId)
+{
+    QSqlQuery q;
+
+    beginOperation(tr("Unlink transfer"));
+
+    QVector<JournalRow> rows = fetchRows(transactionId, false);
+    for (int i = 0; i < rows.size(); ++i)
+    {
+        journal.recordChange(transactionId, JournalEntry::FieldRelate, rows.at(i).id_relate, QVariant(QVariant::Int));
+    }
+
+    q.prepare("UPDATE trans SET id_relate = NULL WHERE pk_uid = ?");
+    q.addBindValue(transactionId);
+    return endOperation(q.exec());
+}
+
+/*
+ *  sets the other leg of a transfer to the negated amount of this one, converted
+ *  when the accounts use different currencies
+ */
+bool TransactionsModel::syncTransferAmount(int &transactionId)
+{
+    QVector<JournalRow> rows = fetchRows(transactionId, false);
+    if (rows.isEmpty()) return false;
+
+    double amount = rows.at(0).amount;
+    return setAmount(transactionId, amount);
+}
+
+bool TransactionsModel::deleteTransaction(int &transactionId)
+{
+    QSqlQuery q;
+    LedgerDeltas deltas;
+
+    beginOperation(tr("Delete transaction"));
+
+    QVector<JournalRow> rows = fetchRows(transactionId, true);
+    for (int i = 0; i < rows.size(); ++i)
+    {
+        int month = monthOf(rows.at(i).date_trans);
+        journal.recordDelete(rows.at(i));
+        deltas[qMakePair(rows.at(i).id_account, month)] -= rows.at(i).amount;
+
+        //split lines go with their parent
+        QVector<SplitLine> lines = splits(rows.at(i).pk_uid);
+        for (int j = 0; j < lines.size(); ++j)
+        {
+            journal.recordSplitDelete(lines.at(j));
+            deltas[qMakePair(lines.at(j).id_account, month)] += lines.at(j).amount;
+        }
+        if (!deleteSplits(lines)) return endOperation(false);
+    }
+
+    q.prepare("DELETE FROM trans WHERE pk_uid=? OR id_relate=?");
+    q.addBindValue(transactionId);
+    q.addBindValue(transactionId);
+    if (!q.exec()) return endOperation(false);
+    return endOperation(applyBalanceDeltas(deltas));
+}
+
+bool TransactionsModel::moveTransaction(int &accountId, int &transactionId)
+{
+    QSqlQuery updateQuery;
+    LedgerDeltas deltas;
+
+    beginOperation(tr("Move transaction"));
+
+    QVector<JournalRow> rows = fetchRows(transactionId, false);
+    for (int i = 0; i < rows.size(); ++i)
+    {
+        int month = monthOf(rows.at(i).date_trans);
+        journal.recordChange(transactionId, JournalEntry::FieldAccount, rows.at(i).id_account, accountId);
+        deltas[qMakePair(rows.at(i).id_account, month)] -= rows.at(i).amount;
+        deltas[qMakePair(accountId, month)] += rows.at(i).amount;
+    }
+
+    updateQuery.prepare("UPDATE trans SET id_account=? WHERE pk_uid =?");
+    updateQuery.addBindValue(accountId);
+    updateQuery.addBindValue(transactionId);
+    if (!updateQuery.exec()) return endOperation(false);
+    return endOperation(applyBalanceDeltas(deltas));
+}
+
+/*
+ *  adds many transactions to one account as a single operation, with one balance update per month
+ */
+bool TransactionsModel::importTransactions(int accountId, const QVector<JournalRow> &rows, QList<int> *ids)
+{
+    QSqlQuery q;
+    LedgerDeltas deltas;
+
+    beginOperation(tr("Import transactions"));
+
+    q.prepare("INSERT INTO trans (id_account, date_trans, comment, amount, reconciled) VALUES (?,?,?,?,0)");
+    for (int i = 0; i < rows.size(); ++i)
+    {
+        JournalRow row = rows.at(i);
+        q.addBindValue(accountId);
+        q.addBindValue(row.date_trans);
+        q.addBindValue(row.comment);
+        q.addBindValue(row.amount);
+        if (!q.exec()) return endOperation(false);
+
+        row.pk_uid = q.lastInsertId().toInt();
+        row.id_account = accountId;
+        row.reconciled = 0;
+        journal.recordInsert(row);
+        deltas[qMakePair(accountId, monthOf(row.date_trans))] += row.amount;
+        if (ids) ids->append(row.pk_uid);
+    }
+
+    return endOperation(applyBalanceDeltas(deltas));
+}
+
+/*
+ *  runs the rules over the given transactions and moves the matches
+ */
+bool TransactionsModel::categorize(const RuleMatcher &rules, const QList<int> &ids, int *moved)
+{
+    if (moved) *moved = 0;
+    if (rules.isEmpty() || ids.isEmpty()) return true;
+
+    QSqlQuery q;
+    q.setForwardOnly(true);
+    q.prepare("SELECT pk_uid, id_account, comment, amount, date_trans FROM trans WHERE id_relate IS NULL AND pk_uid IN (" + idList(ids) + ")");
+    return categorizeRows(rules, q, moved);
+}
+
+/*
+ *  runs the rules over every transaction that isn't a transfer leg
+ */
+bool TransactionsModel::categorizeAll(const RuleMatcher &rules, int *moved)
+{
+    if (moved) *moved = 0;
+    if (rules.isEmpty()) return true;
+
+    QSqlQuery q;
+    q.setForwardOnly(true);
+    q.prepare("SELECT pk_uid, id_account, comment, amount, date_trans FROM trans WHERE id_relate IS NULL");
+    return categorizeRows(rules, q, moved);
+}
+
+/*
+ *  matches every row of the prepared query in one pass, then applies the moves as one
+ *  UPDATE per target account inside a single operation
+ */
+bool TransactionsModel::categorizeRows(const RuleMatcher &rules, QSqlQuery &q, int *moved)
+{
+    QHash<int, QList<int> > targets;
+    LedgerDeltas deltas;
+    int count = 0;
+
+    beginOperation(tr("Categorize transactions"));
+
+    if (!q.exec()) return endOperation(false);
+    while (q.next())
+    {
+        int pk_uid = q.value(0).toInt();
+        int accountId = q.value(1).toInt();
+        double amount = q.value(3).toDouble();
+        int month = monthOf(q.value(4));
+        int target = rules.match(q.value(2).toString(), amount);
+        if (target < 0 || target == accountId) continue;
+
+        journal.recordChange(pk_uid, JournalEntry::FieldAccount, accountId, target);
+        targets[target].append(pk_uid);
+        deltas[qMakePair(accountId, month)] -= amount;
+        deltas[qMakePair(target, month)] += amount;
+        ++count;
+    }
+
+    QSqlQuery updateQuery;
+    QHash<int, QList<int> >::const_iterator i;
+    for (i = targets.constBegin(); i != targets.constEnd(); ++i)
+    {
+        updateQuery.prepare("UPDATE trans SET id_account = ? WHERE pk_uid IN (" + idList(i.value()) + ")");
+        updateQuery.addBindValue(i.key());
+        if (!updateQuery.exec()) return endOperation(false);
+    }
+    if (!applyBalanceDeltas(deltas)) return endOperation(false);
+
+    if (moved) *moved = count;
+    return endOperation(true);
+}
+
+/*
+ *  limits how many operations can be undone. batch jobs set this to 0
+ */
+void TransactionsModel::setUndoLimit(int entries)
+{
+    journal.setMaxEntries(entries);
+}
+
+void TransactionsModel::clearUndo()
+{
+    journal.clear();
+    emit journalChanged();
+}
+
+/*
+ *  returns the pk_uid of the row created by the last successful addTransaction
+ */
+int TransactionsModel::lastTransactionId() const
+{
+    return lastInsertId;
+}
+
+ExchangeRates *TransactionsModel::exchangeRates()
+{
+    return &rates;
+}
+
+/*
+ *  returns the iso currency code of an account
+ */
+QString TransactionsModel::accountCurrency(int accountId)
+{
+    QSqlQuery q;
+    q.prepare("SELECT currency FROM account WHERE pk_uid = ?");
+    q.addBindValue(accountId);
+    if (q.exec() && q.first() && !q.value(0).toString().isEmpty())
+    {
+        return q.value(0).toString();
+    }
+    return baseCurrency;
+}
+
+/*
+ *  returns the split lines of a transaction, empty if it isn't split
+ */
+QVector<SplitLine> TransactionsModel::splits(int pk_uid)
+{
+    QVector<SplitLine> lines;
+    QSqlQuery q;
+    q.prepare("SELECT pk_uid, id_trans, id_account, comment, amount FROM trans_split WHERE id_trans = ? ORDER BY pk_uid");
+    q.addBindValue(pk_uid);
+    q.exec();
+    while (q.next())
+    {
+        SplitLine line;
+        line.pk_uid = q.value(0).toInt();
+        line.id_trans = q.value(1).toInt();
+        line.id_account = q.value(2).toInt();
+        line.comment = q.value(3).toString();
+        line.amount = q.value(4).toDouble();
+        lines.append(line);
+    }
+    return lines;
+}
+
+/*
+ *  replaces the split lines of a transaction. lines keep their pk_uid when edited (new lines
+ *  use pk_uid <= 0), and only the lines that actually changed touch the database and balances.
+ *  the parent amount is set to the sum of the lines
+ */
+bool TransactionsModel::setSplits(int pk_uid, const QVector<SplitLine> &lines)
+{
+    QVector<SplitLine> oldLines = splits(pk_uid);
+    QHash<int,SplitLine> oldById;
+    QVector<SplitLine> removed;
+    QVector<SplitLine> added;
+    LedgerDeltas deltas;
+    double total = 0;
+
+    //split lines count in the month of their parent
+    QVector<JournalRow> rows = fetchRows(pk_uid, false);
+    int month = rows.isEmpty() ? 0 : monthOf(rows.at(0).date_trans);
+
+    for (int i = 0; i < oldLines.size(); ++i)
+    {
+        oldById.insert(oldLines.at(i).pk_uid, oldLines.at(i));
+    }
+
+    //work out which lines were removed, added or edited
+    for (int i = 0; i < lines.size(); ++i)
+    {
+        SplitLine line = lines.at(i);
+        line.id_trans = pk_uid;
+        total += line.amount;
+        if (line.pk_uid > 0 && oldById.contains(line.pk_uid))
+        {
+            SplitLine old = oldById.take(line.pk_uid);
+            if (old.id_account == line.id_account && old.comment == line.comment && qFuzzyCompare(1 + old.amount, 1 + line.amount))
+            {
+                continue;  //unchanged
+            }
+            removed.append(old);
+        }
+        added.append(line);
     }
-    return flags;
+    removed += oldById.values().toVector();
+
+    beginOperation(tr("Split transaction"));
+
+    if (!deleteSplits(removed)) return endOperation(false);
+    for (int i = 0; i < removed.size(); ++i)
+    {
+        journal.recordSplitDelete(removed.at(i));
+        deltas[qMakePair(removed.at(i).id_account, month)] += removed.at(i).amount;
+    }
+
+    QSqlQuery q;
+    q.prepare("INSERT INTO trans_split (pk_uid, id_trans, id_account, comment, amount) VALUES (?,?,?,?,?)");
+    for (int i = 0; i < added.size(); ++i)
+    {
+        SplitLine &line = added[i];
+        q.addBindValue(line.pk_uid > 0 ? QVariant(line.pk_uid) : QVariant(QVariant::Int));
+        q.addBindValue(line.id_trans);
+        q.addBindValue(line.id_account);
+        q.addBindValue(line.comment);
+        q.addBindValue(line.amount);
+        if (!q.exec()) return endOperation(false);
+        line.pk_uid = q.lastInsertId().toInt();
+        journal.recordSplitInsert(line);
+        deltas[qMakePair(line.id_account, month)] -= line.amount;
+    }
+    if (!applyBalanceDeltas(deltas)) return endOperation(false);
+
+    //keep the parent amount equal to the sum of its lines
+    if (!lines.isEmpty() && rows.size() == 1 && !qFuzzyCompare(1 + rows.at(0).amount, 1 + total))
+    {
+        if (!updateField(pk_uid, JournalEntry::FieldAmount, total, -1 * total)) return endOperation(false);
+    }
+
+    return endOperation(true);
 }
 
-bool TransactionsModel::setData(const QModelIndex &index, const QVariant &value, int /*role*/)
+/*
+ *  true when the loaded transaction has split lines
+ */
+bool TransactionsModel::isSplit(int pk_uid) const
 {
-    if (       index.column() == col_pk_uid
-            || index.column() == col_id_account
-            || index.column() == col_relate_account
-            || index.column() == col_total
-            || index.column() == col_reconciled)
+    return splitCache.contains(pk_uid);
+}
+
+/*
+ *  groups the following mutator calls into one database transaction and one undo entry
+ */
+void TransactionsModel::beginBulk(const QString &description)
+{
+    beginOperation(description);
+}
+
+/*
+ *  closes a bulk operation. if any mutator inside it failed, everything is rolled back
+ */
+bool TransactionsModel::endBulk()
+{
+    return endOperation(true);
+}
+
+bool TransactionsModel::undo()
+{
+    if (!journal.canUndo()) return false;
+
+    QSqlDatabase db = QSqlDatabase::database();
+    JournalEntry entry = journal.takeUndo();
+    db.transaction();
+    if (applyEntry(entry, false) && db.commit())
     {
-        return false;
+        journal.pushRedo(entry);
+        emit journalChanged();
+        emitCommentsChanged(entry);
+        return true;
     }
-    QModelIndex primaryKeyIndex = QSqlQueryModel::index(index.row(),0);
-    int pk_uid = data(primaryKeyIndex, Qt::EditRole).toInt();
+    db.rollback();
+    journal.pushUndo(entry);
+    return false;
+}
 
-    clear();
+bool TransactionsModel::redo()
+{
+    if (!journal.canRedo()) return false;
 
-    bool success;
-    if (index.column() == col_date) {
-        success = setDate(pk_uid,value.toString());
+    QSqlDatabase db = QSqlDatabase::database();
+    JournalEntry entry = journal.takeRedo();
+    db.transaction();
+    if (applyEntry(entry, true) && db.commit())
+    {
+        journal.pushUndo(entry);
+        emit journalChanged();
+        emitCommentsChanged(entry);
+        return true;
     }
-    else if (index.column() == col_comment) {
-        success = setComment(pk_uid,value.toString());
+    db.rollback();
+    journal.pushRedo(entry);
+    return false;
+}
+
+bool TransactionsModel::canUndo() const
+{
+    return journal.canUndo();
+}
+
+bool TransactionsModel::canRedo() const
+{
+    return journal.canRedo();
+}
+
+QString TransactionsModel::undoText() const
+{
+    return journal.undoText();
+}
+
+QString TransactionsModel::redoText() const
+{
+    return journal.redoText();
+}
+
+/*
+ *  operations nest: only the outermost one opens the database transaction and the journal entry
+ */
+void TransactionsModel::beginOperation(const QString &description)
+{
+    if (operationDepth == 0)
+    {
+        QSqlDatabase::database().transaction();
+        journal.begin(description);
+        operationFailed = false;
     }
-    else if (index.column() == col_amount) {
-        double amt;
-        amt = value.toFloat();
-        success = setAmount(pk_uid,amt);
+    ++operationDepth;
+}
+
+bool TransactionsModel::endOperation(bool success)
+{
+    if (!success)
+    {
+        operationFailed = true;
     }
-    else {
-        success = false;
+    if (--operationDepth > 0)
+    {
+        return success;
     }
-    refresh();
-    return success;
+
+    QSqlDatabase db = QSqlDatabase::database();
+    if (operationFailed || !db.commit())
+    {
+        db.rollback();
+        journal.discard();
+        return false;
+    }
+    JournalEntry entry = journal.currentEntry();
+    journal.commit();
+    emit journalChanged();
+    emitCommentsChanged(entry);
+    return true;
 }
 
-void TransactionsModel::refresh()
+/*
+ *  tells the autocomplete index which comments an entry's rows had before it and have
+ *  after it, so their counts and last uses are read again. reconciling changes neither
+ */
+void TransactionsModel::emitCommentsChanged(const JournalEntry &entry)
 {
-    setQuery("SELECT pk_uid, id_account, relate_account, date_trans, comment, amount, total, reconciled FROM trans_total ORDER BY date_trans, pk_uid");
-    setHeaderData(col_pk_uid,Qt::Horizontal,QObject::tr("pk_uid"));
-    setHeaderData(col_id_account,Qt::Horizontal,QObject::tr("id_account"));
-    setHeaderData(col_relate_account,Qt::Horizontal,QObject::tr("relate_account"));
-    setHeaderData(col_date,Qt::Horizontal,QObject::tr("Date"));
-    setHeaderData(col_comment,Qt::Horizontal,QObject::tr("Comment"));
-    setHeaderData(col_amount,Qt::Horizontal,QObject::tr("Amount"));
-    setHeaderData(col_total,Qt::Horizontal,QObject::tr("Total"));
-    setHeaderData(col_reconciled,Qt::Horizontal,QObject::tr("Reconciled"));
-    while(canFetchMore())
+    if (receivers(SIGNAL(commentsChanged(QStringList))) == 0)
+    {
+        return;
+    }
+
+    QStringList comments;
+    QList<int> ids;
+    for (int i = 0; i < entry.inserted.size(); ++i)
     {
-        fetchMore();
+        comments.append(entry.inserted.at(i).comment);
+    }
+    for (int i = 0; i < entry.deleted.size(); ++i)
+    {
+        comments.append(entry.deleted.at(i).comment);
+    }
+    for (int i = 0; i < entry.changes.size(); ++i)
+    {
+        const JournalEntry::Change &c = entry.changes.at(i);
+        if (c.field == JournalEntry::FieldComment)
+        {
+            comments.append(c.before.toString());
+            comments.append(c.after.toString());
+        }
+        else if (c.field != JournalEntry::FieldReconciled)
+        {
+            ids.append(c.pk_uid);
+        }
+    }
+    if (!ids.isEmpty())
+    {
+        QSqlQuery q;
+        q.setForwardOnly(true);
+        q.exec("SELECT DISTINCT comment FROM trans WHERE pk_uid IN (" + idList(ids) + ")");
+        while (q.next())
+        {
+            comments.append(q.value(0).toString());
+        }
+    }
+    comments.removeAll(QString());
+    comments.removeDuplicates();
+    if (!comments.isEmpty())
+    {
+        emit commentsChanged(comments);
     }
 }
 
-bool TransactionsModel::setDate(int pk_uid, const QString &transactionDate)
+/*
+ *  sets a field on a transaction and, with relatedValue, on its transfer mirror
+ */
+bool TransactionsModel::updateField(int pk_uid, JournalEntry::Field field, const QVariant &value, const QVariant &relatedValue)
 {
     QSqlQuery q;
+    QString column = JournalEntry::columnName(field);
+    LedgerDeltas deltas;
+
+    QVector<JournalRow> rows = fetchRows(pk_uid, true);
+    for (int i = 0; i < rows.size(); ++i)
+    {
+        const JournalRow &row = rows.at(i);
+        QVariant after = (row.pk_uid == pk_uid) ? value : relatedValue;
+        journal.recordChange(row.pk_uid, field, rowValue(row, field), after);
+        if (field == JournalEntry::FieldAmount)
+        {
+            deltas[qMakePair(row.id_account, monthOf(row.date_trans))] += after.toDouble() - row.amount;
+        }
+        else if (field == JournalEntry::FieldDate && monthOf(row.date_trans) != monthOf(after))
+        {
+            //the row and its split lines move to another month's budget totals
+            int before = monthOf(row.date_trans);
+            deltas[qMakePair(row.id_account, before)] -= row.amount;
+            deltas[qMakePair(row.id_account, monthOf(after))] += row.amount;
+            QVector<SplitLine> lines = splits(row.pk_uid);
+            for (int j = 0; j < lines.size(); ++j)
+            {
+                deltas[qMakePair(lines.at(j).id_account, before)] += lines.at(j).amount;
+                deltas[qMakePair(lines.at(j).id_account, monthOf(after))] -= lines.at(j).amount;
+            }
+        }
+    }
 
     //first update the selected transaction
-    q.prepare("UPDATE trans SET date_trans = ? WHERE pk_uid = ?");
-    q.addBindValue(transactionDate);
+    q.prepare("UPDATE trans SET " + column + " = ? WHERE pk_uid = ?");
+    q.addBindValue(value);
     q.addBindValue(pk_uid);
     if (!q.exec()) return false;
 
     //next update the related transaction (if exists)
     q.clear();
-    q.prepare("UPDATE trans SET date_trans = ? WHERE id_relate = ?");
-    q.addBindValue(transactionDate);
+    q.prepare("UPDATE trans SET " + column + " = ? WHERE id_relate = ?");
+    q.addBindValue(relatedValue);
     q.addBindValue(pk_uid);
     if (!q.exec()) return false;
 
-    return true;
+    return applyBalanceDeltas(deltas);
 }
 
-bool TransactionsModel::setComment(int pk_uid, const QString &transactionComment)
+/*
+ *  reads a transaction (and optionally the rows related to it) as journal rows
+ */
+QVector<JournalRow> TransactionsModel::fetchRows(int pk_uid, bool includeRelated)
 {
+    QVector<JournalRow> rows;
     QSqlQuery q;
 
-    //first update the selected transaction
-    q.prepare("UPDATE trans SET comment = ? WHERE pk_uid = ?");
-    q.addBindValue(transactionComment);
-    q.addBindValue(pk_uid);
-    if (!q.exec()) return false;
-
-    //next update the related transaction (if exists)
-    q.clear();
-    q.prepare("UPDATE trans SET comment = ? WHERE id_relate = ?");
-    q.addBindValue(transactionComment);
-    q.addBindValue(pk_uid);
-    if (!q.exec()) return false;
+    if (includeRelated)
+    {
+        q.prepare("SELECT pk_uid, id_account, date_trans, comment, amount, id_relate, reconciled FROM trans WHERE pk_uid = ? OR id_relate = ?");
+        q.addBindValue(pk_uid);
+        q.addBindValue(pk_uid);
+    }
+    else
+    {
+        q.prepare("SELECT pk_uid, id_account, date_trans, comment, amount, id_relate, reconciled FROM trans WHERE pk_uid = ?");
+        q.addBindValue(pk_uid);
+    }
+    q.exec();
 
-    return true;
+    while (q.next())
+    {
+        JournalRow row;
+        row.pk_uid = q.value(0).toInt();
+        row.id_account = q.value(1).toInt();
+        row.date_trans = q.value(2);
+        row.comment = q.value(3).toString();
+        row.amount = q.value(4).toDouble();
+        row.id_relate = q.value(5);
+        row.reconciled = q.value(6).toInt();
+        rows.append(row);
+    }
+    return rows;
 }
 
-bool TransactionsModel::setAmount(int pk_uid, double &transactionAmount)
+/*
+ *  sums amounts per account and month over just the given rows. split lines are taken
+ *  from the given split ids and from the given parents, since they follow the parent's date
+ */
+TransactionsModel::LedgerDeltas TransactionsModel::accountSums(const QList<int> &ids, const QList<int> &splitIds)
 {
+    LedgerDeltas sums;
     QSqlQuery q;
 
-    //first update the selected transaction
-    q.prepare("UPDATE trans SET amount = ? WHERE pk_uid = ?");
-    q.addBindValue(transactionAmount);
-    q.addBindValue(pk_uid);
-    if (!q.exec()) return false;
+    if (!ids.isEmpty())
+    {
+        q.exec("SELECT id_account, date_trans, SUM(amount) FROM trans WHERE pk_uid IN (" + idList(ids) + ") GROUP BY id_account, date_trans");
+        while (q.next())
+        {
+            sums[qMakePair(q.value(0).toInt(), monthOf(q.value(1)))] += q.value(2).toDouble();
+        }
+    }
 
-    //next update the related transaction (if exists)
-    q.clear();
-    q.prepare("UPDATE trans SET amount = ? WHERE id_relate = ?");
-    q.addBindValue(-1 * transactionAmount);
-    q.addBindValue(pk_uid);
-    if (!q.exec()) return false;
+    //split lines count against their account like a transfer's mirror leg
+    if (!ids.isEmpty() || !splitIds.isEmpty())
+    {
+        q.exec("SELECT s.id_account, t.date_trans, SUM(s.amount) FROM trans_split s LEFT JOIN trans t ON t.pk_uid = s.id_trans "
+               "WHERE s.pk_uid IN (" + idList(splitIds) + ") OR s.id_trans IN (" + idList(ids) + ") GROUP BY s.id_account, t.date_trans");
+        while (q.next())
+        {
+            sums[qMakePair(q.value(0).toInt(), monthOf(q.value(1)))] -= q.value(2).toDouble();
+        }
+    }
+    return sums;
+}
+
+/*
+ *  applies per (account, month) changes to the balance cache and to the monthly totals
+ *  of every budget whose subtree holds the account. the account's ancestors are walked
+ *  through id_parent, so no trans rows are read. a budget's subtree can mix currencies, so
+ *  each change is converted into the currency of the budget's account at the rate of the
+ *  month's first day; without a rate the amount counts unconverted
+ */
+bool TransactionsModel::applyBalanceDeltas(const LedgerDeltas &deltas)
+{
+    QHash<int,double> balances;
+    QHash<int,QString> currencies;
+    QSqlQuery insertQuery;
+    QSqlQuery updateQuery;
+    QSqlQuery budgetQuery;
+    QSqlQuery budgetInsertQuery;
+    QSqlQuery budgetUpdateQuery;
+    insertQuery.prepare("INSERT OR IGNORE INTO account_balance (id_account, balance) VALUES (?,0)");
+    updateQuery.prepare("UPDATE account_balance SET balance = balance + ? WHERE id_account = ?");
+    budgetQuery.prepare("WITH RECURSIVE ancestor(id) AS "
+                        "(SELECT ? UNION SELECT account.id_parent FROM account JOIN ancestor ON account.pk_uid = ancestor.id WHERE account.id_parent IS NOT NULL) "
+                        "SELECT budget.pk_uid, COALESCE(NULLIF(account.currency, ''), '" baseCurrency "') "
+                        "FROM budget JOIN account ON account.pk_uid = budget.id_account WHERE budget.id_account IN (SELECT id FROM ancestor)");
+    budgetInsertQuery.prepare("INSERT OR IGNORE INTO budget_month (id_budget, month, spent) VALUES (?,?,0)");
+    budgetUpdateQuery.prepare("UPDATE budget_month SET spent = spent + ? WHERE id_budget = ? AND month = ?");
+
+    LedgerDeltas::const_iterator d;
+    for (d = deltas.constBegin(); d != deltas.constEnd(); ++d)
+    {
+        if (qFuzzyIsNull(d.value())) continue;
 
+        int accountId = d.key().first;
+        int month = d.key().second;
+        balances[accountId] += d.value();
+
+        budgetQuery.addBindValue(accountId);
+        if (!budgetQuery.exec()) return false;
+        QList<QPair<int,QString> > budgets;
+        while (budgetQuery.next())
+        {
+            budgets.append(qMakePair(budgetQuery.value(0).toInt(), budgetQuery.value(1).toString()));
+        }
+        if (!budgets.isEmpty() && !currencies.contains(accountId))
+        {
+            currencies.insert(accountId, accountCurrency(accountId));
+        }
+
+        for (int i = 0; i < budgets.size(); ++i)
+        {
+            double spent = rates.convert(d.value(), currencies.value(accountId), budgets.at(i).second, monthStart(month));
+            budgetInsertQuery.addBindValue(budgets.at(i).first);
+            budgetInsertQuery.addBindValue(month);
+            if (!budgetInsertQuery.exec()) return false;
+            budgetUpdateQuery.addBindValue(spent);
+            budgetUpdateQuery.addBindValue(budgets.at(i).first);
+            budgetUpdateQuery.addBindValue(month);
+            if (!budgetUpdateQuery.exec()) return false;
+        }
+    }
+
+    QHash<int,double>::const_iterator i;
+    for (i = balances.constBegin(); i != balances.constEnd(); ++i)
+    {
+        if (qFuzzyIsNull(i.value())) continue;
+
+        insertQuery.addBindValue(i.key());
+        if (!insertQuery.exec()) return false;
+        updateQuery.addBindValue(i.value());
+        updateQuery.addBindValue(i.key());
+        if (!updateQuery.exec()) return false;
+    }
     return true;
 }
 
-bool TransactionsModel::setReconcile(int pk_uid, bool reconcileState)
+/*
+ *  replays a journal entry (forward) or its inverse with set-based statements. balances and
+ *  budget totals are adjusted by the difference of per-account sums over the touched rows only
+ */
+bool TransactionsModel::applyEntry(const JournalEntry &entry, bool forward)
 {
-    QSqlQuery q;
+    QList<int> ids = entry.touchedIds();
+    QList<int> splitIds = entry.touchedSplitIds();
+    LedgerDeltas before = accountSums(ids, splitIds);
+    QList<int> removeIds;
 
-    if(reconcileState)  //reconciled should be set to true
+    if (forward)
     {
-        q.prepare("UPDATE trans SET reconciled = 1 WHERE pk_uid = ?");
+        if (!insertRows(entry.inserted)) return false;
+        if (!applyChanges(entry.changes, true)) return false;
+        if (!deleteSplits(entry.splitsDeleted)) return false;
+        if (!insertSplits(entry.splitsInserted)) return false;
+        for (int i = 0; i < entry.deleted.size(); ++i)
+        {
+            removeIds.append(entry.deleted.at(i).pk_uid);
+        }
     }
-    else                //reconciled should be set to false
+    else
     {
-        q.prepare("UPDATE trans SET reconciled = 0 WHERE pk_uid = ?");
+        if (!insertRows(entry.deleted)) return false;
+        if (!applyChanges(entry.changes, false)) return false;
+        if (!deleteSplits(entry.splitsInserted)) return false;
+        if (!insertSplits(entry.splitsDeleted)) return false;
+        for (int i = 0; i < entry.inserted.size(); ++i)
+        {
+            removeIds.append(entry.inserted.at(i).pk_uid);
+        }
+    }
+    if (!deleteRows(removeIds)) return false;
+
+    LedgerDeltas deltas = accountSums(ids, splitIds);
+    LedgerDeltas::const_iterator i;
+    for (i = before.constBegin(); i != before.constEnd(); ++i)
+    {
+        deltas[i.key()] -= i.value();
+    }
+    return applyBalanceDeltas(deltas);
+}
+
+bool TransactionsModel::insertRows(const QVector<JournalRow> &rows)
+{
+    if (rows.isEmpty()) return true;
+
+    QVariantList pk_uid, id_account, date_trans, comment, amount, id_relate, reconciled;
+    for (int i = 0; i < rows.size(); ++i)
+    {
+        const JournalRow &row = rows.at(i);
+        pk_uid << row.pk_uid;
+        id_account << row.id_account;
+        date_trans << row.date_trans;
+        comment << row.comment;
+        amount << row.amount;
+        id_relate << row.id_relate;
+        reconciled << row.reconciled;
     }
+
+    QSqlQuery q;
+    q.prepare("INSERT INTO trans (pk_uid, id_account, date_trans, comment, amount, id_relate, reconciled) VALUES (?,?,?,?,?,?,?)");
     q.addBindValue(pk_uid);
-    if(!q.exec()) return false;
-    return true;
+    q.addBindValue(id_account);
+    q.addBindValue(date_trans);
+    q.addBindValue(comment);
+    q.addBindValue(amount);
+    q.addBindValue(id_relate);
+    q.addBindValue(reconciled);
+    return q.execBatch();
 }
 
-bool TransactionsModel::addTransaction(int &accountId, QString &transactionDate,QString &transactionComment,double &transactionAmount)
+bool TransactionsModel::deleteRows(const QList<int> &ids)
 {
+    if (ids.isEmpty()) return true;
+
     QSqlQuery q;
-    q.prepare("INSERT INTO trans (id_account, date_trans, comment, amount, reconciled) VALUES (?,?,?,?,0)");
-    q.addBindValue(accountId);
-    q.addBindValue(transactionDate);
-    q.addBindValue(transactionComment);
-    q.addBindValue(transactionAmount);
-    return q.exec();
+    return q.exec("DELETE FROM trans WHERE pk_uid IN (" + idList(ids) + ")");
 }
 
-bool TransactionsModel::addTransactionRelation(int &transactionId, int &relateId)
+bool TransactionsModel::insertSplits(const QVector<SplitLine> &lines)
 {
+    if (lines.isEmpty()) return true;
+
+    QVariantList pk_uid, id_trans, id_account, comment, amount;
+    for (int i = 0; i < lines.size(); ++i)
+    {
+        pk_uid << lines.at(i).pk_uid;
+        id_trans << lines.at(i).id_trans;
+        id_account << lines.at(i).id_account;
+        comment << lines.at(i).comment;
+        amount << lines.at(i).amount;
+    }
+
     QSqlQuery q;
-    q.prepare("UPDATE trans SET id_relate=? WHERE pk_uid=?");
-    q.addBindValue(relateId);
-    q.addBindValue(transactionId);
-    return q.exec();
+    q.prepare("INSERT INTO trans_split (pk_uid, id_trans, id_account, comment, amount) VALUES (?,?,?,?,?)");
+    q.addBindValue(pk_uid);
+    q.addBindValue(id_trans);
+    q.addBindValue(id_account);
+    q.addBindValue(comment);
+    q.addBindValue(amount);
+    return q.execBatch();
 }
 
-bool TransactionsModel::deleteTransaction(int &transactionId)
+bool TransactionsModel::deleteSplits(const QVector<SplitLine> &lines)
 {
+    if (lines.isEmpty()) return true;
+
+    QList<int> ids;
+    for (int i = 0; i < lines.size(); ++i)
+    {
+        ids.append(lines.at(i).pk_uid);
+    }
+
     QSqlQuery q;
-    q.prepare("DELETE FROM trans WHERE pk_uid=? OR id_relate=?");
-    q.addBindValue(transactionId);
-    q.addBindValue(transactionId);
-    return q.exec();
+    return q.exec("DELETE FROM trans_split WHERE pk_uid IN (" + idList(ids) + ")");
 }
 
-bool TransactionsModel::moveTransaction(int &accountId, int &transactionId)
+/*
+ *  writes the before (undo) or after (redo) values back, one UPDATE per distinct (field, value)
+ */
+bool TransactionsModel::applyChanges(const QVector<JournalEntry::Change> &changes, bool forward)
 {
-    QSqlQuery updateQuery;
-    updateQuery.prepare("UPDATE trans SET id_account=? WHERE pk_uid =?");
-    updateQuery.addBindValue(accountId);
-    updateQuery.addBindValue(transactionId);
-    return updateQuery.exec();
+    QHash<QString,int> groupIndex;
+    QList<JournalEntry::Field> groupField;
+    QList<QVariant> groupValue;
+    QList< QList<int> > groupIds;
+
+    for (int i = 0; i < changes.size(); ++i)
+    {
+        const JournalEntry::Change &c = changes.at(i);
+        const QVariant &value = forward ? c.after : c.before;
+        QString key = QString::number(c.field) + (value.isNull() ? QString("|null") : "|" + value.toString());
+        if (!groupIndex.contains(key))
+        {
+            groupIndex.insert(key, groupIds.size());
+            groupField.append(c.field);
+            groupValue.append(value);
+            groupIds.append(QList<int>());
+        }
+        groupIds[groupIndex.value(key)].append(c.pk_uid);
+    }
+
+    QSqlQuery q;
+    for (int i = 0; i < groupIds.size(); ++i)
+    {
+        q.prepare(QString("UPDATE trans SET ") + JournalEntry::columnName(groupField.at(i)) + " = ? WHERE pk_uid IN (" + idList(groupIds.at(i)) + ")");
+        q.addBindValue(groupValue.at(i));
+        if (!q.exec()) return false;
+    }
+    return true;
+}
+
+QVariant TransactionsModel::rowValue(const JournalRow &row, JournalEntry::Field field)
+{
+    switch (field)
+    {
+    case JournalEntry::FieldAccount:
+        return row.id_account;
+    case JournalEntry::FieldDate:
+        return row.date_trans;
+    case JournalEntry::FieldComment:
+        return row.comment;
+    case JournalEntry::FieldAmount:
+        return row.amount;
+    case JournalEntry::FieldReconciled:
+        return row.reconciled;
+    case JournalEntry::FieldRelate:
+        return row.id_relate;
+    }
+    return QVariant();
+}
+
+/*
+ *  formats ids as a literal list for IN (...) so set-based statements aren't limited by bind variables
+ */
+QString TransactionsModel::idList(const QList<int> &ids)
+{
+    QStringList s;
+    for (int i = 0; i < ids.size(); ++i)
+    {
+        s.append(QString::number(ids.at(i)));
+    }
+    return s.join(",");
+}
+
+/*
+ *  the yyyymm budget month of a julian day number, 0 when the date is missing
+ */
+int TransactionsModel::monthOf(const QVariant &julianDay)
+{
+    if (julianDay.isNull()) return 0;
+
+    QDate date = QDate::fromJulianDay(julianDay.toLongLong());
+    return date.year() * 100 + date.month();
+}
+
+/*
+ *  the first day of a yyyymm budget month. budget amounts are converted at its rate
+ */
+QDate TransactionsModel::monthStart(int month)
+{
+    return QDate(month / 100, month % 100, 1);
 }
 
 QVariant TransactionsModel::data(const QModelIndex &item, int role) const
 {
-    QVariant d = QSqlQueryModel::data(item, role);
-    if (item.column() == col_amount || item.column() == col_total)  //check for currency column
+    if (!item.isValid() || item.row() >= rows.size())
+    {
+        return QVariant();
+    }
+    const Row &row = rows.at(item.row());
+    QVariant d;
+    if (role == Qt::DisplayRole || role == Qt::EditRole)
+    {
+        d = row.at(item.column());
+    }
+    if (item.column() == col_date && !d.isNull())  //dates are stored as julian day numbers
+    {
+        if (role == Qt::DisplayRole)
+        {
+            return QVariant(QDate::fromJulianDay(d.toLongLong()).toString("yyyy-MM-dd"));
+        }
+        else if (role == Qt::EditRole)
+        {
+            return QVariant(QDate::fromJulianDay(d.toLongLong()));
+        }
+        return d;
+    }
+    else if (item.column() == col_amount || item.column() == col_total)  //check for currency column
     {
         if(role == Qt::TextAlignmentRole)
         {
@@ -197,8 +1994,8 @@ QVariant TransactionsModel::data(const QModelIndex &item, int role) const
         }
         else if (role == Qt::DisplayRole)
         {
-            QLocale us(QLocale::English,QLocale::UnitedStates);
-            return QVariant(us.toCurrencyString(d.toDouble(),us.currencySymbol()));
+            QString currency = row.at(col_currency).toString();
+            return QVariant(ExchangeRates::formatAmount(d.toDouble(),currency));
         }
         else
         {
@@ -207,18 +2004,47 @@ QVariant TransactionsModel::data(const QModelIndex &item, int role) const
     }
     else if (item.column() == col_comment && role == Qt::DisplayRole)  //check for comment (to add transfer information)
     {
-        QModelIndex xferAccountIndex = QSqlQueryModel::index(item.row(),col_relate_account);
-        QString xferAccountName = data(xferAccountIndex,role).toString();
+        int pk_uid = row.at(col_pk_uid).toInt();
+        QString xferAccountName = row.at(col_relate_account).toString();
         if (xferAccountName.length() > 0)
         {
-            QString s = "Transfer (";
+            QString s = pk_uid < 0 ? "Split (" : "Transfer (";
             s.append(xferAccountName);
             s.append("): ");
             s.append(d.toString());
             return QVariant(s);
         }
+        if (isSplit(pk_uid))
+        {
+            QString s = QString("Split (%1): ").arg(splitCache.value(pk_uid).size());
+            s.append(d.toString());
+            return QVariant(s);
+        }
         return d;
     }
+    else if (item.column() == col_comment && role == Qt::ToolTipRole)  //list the lines of a split
+    {
+        int pk_uid = row.at(col_pk_uid).toInt();
+        if (!isSplit(pk_uid))
+        {
+            return d;
+        }
+        QString currency = row.at(col_currency).toString();
+        QStringList tip;
+        QVector<SplitLine> lines = splitCache.value(pk_uid);
+        for (int i = 0; i < lines.size(); ++i)
+        {
+            QString line = accountNames.value(lines.at(i).id_account);
+            line.append(": ");
+            line.append(ExchangeRates::formatAmount(lines.at(i).amount,currency));
+            if (!lines.at(i).comment.isEmpty())
+            {
+                line.append(" (" + lines.at(i).comment + ")");
+            }
+            tip.append(line);
+        }
+        return QVariant(tip.join("\n"));
+    }
     else
     {
         return d;
@@ -1,27 +1,140 @@
 #ifndef TRANSACTIONSMODEL_H
 #define TRANSACTIONSMODEL_H
 
-#include <QSqlQueryModel>
+#include <QAbstractTableModel>
+#include <QSqlQuery>
+#include <QDate>
+#include <QHash>
+#include <QVector>
+#include "undojournal.h"
+#include "exchangerates.h"
+#include "rulematcher.h"
 
-class TransactionsModel : public QSqlQueryModel
+class TransactionsModel : public QAbstractTableModel
 {
     Q_OBJECT
 public:
     explicit TransactionsModel(QObject *parent = 0);
+    static bool createSchema();
+    static bool rebuildBalances();
+    static bool rebuildBudgets(int budgetId = -1);
     Qt::ItemFlags flags(const QModelIndex &index) const;
     bool setData(const QModelIndex &index, const QVariant &value, int role);
     bool setReconcile(int pk_uid, bool reconcileState);
-    bool addTransaction(int &accountId, QString &transactionDate,QString &transactionComment,double &transactionAmount);
+    bool addTransaction(int &accountId, QDate &transactionDate,QString &transactionComment,double &transactionAmount);
     bool addTransactionRelation(int &transactionId, int &relateId);
+    bool clearTransactionRelation(int &transactionId);
+    bool syncTransferAmount(int &transactionId);
     bool deleteTransaction(int &transactionId);
     bool moveTransaction(int &accountId, int &transactionId);
+    bool importTransactions(int accountId, const QVector<JournalRow> &rows, QList<int> *ids = 0);
+    bool categorize(const RuleMatcher &rules, const QList<int> &ids, int *moved = 0);
+    bool categorizeAll(const RuleMatcher &rules, int *moved = 0);
+    void setUndoLimit(int entries);
+    void clearUndo();
+    int lastTransactionId() const;
+    ExchangeRates *exchangeRates();
+    static QString accountCurrency(int accountId);
+    QVector<SplitLine> splits(int pk_uid);
+    bool setSplits(int pk_uid, const QVector<SplitLine> &lines);
+    bool isSplit(int pk_uid) const;
+    void setAccount(int accountId);
+    void setDateRange(const QDate &from, const QDate &to);
+    void setSortKeys(const QList<QPair<int,Qt::SortOrder> > &keys);
+    static bool isSortable(int column);
+    void loadFirst(int windowRows);
+    void loadLast(int windowRows);
+    bool loadFrom(int anchorId, int windowRows);
     void refresh();
+    void setLoadAll(bool all);
+    void fetchAll();
+    bool canFetchMore(const QModelIndex &parent) const;
+    void fetchMore(const QModelIndex &parent);
+    bool canFetchPrevious() const;
+    void fetchPrevious();
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const;
     QVariant data(const QModelIndex &item, int role) const;
+    void beginBulk(const QString &description);
+    bool endBulk();
+    bool undo();
+    bool redo();
+    bool canUndo() const;
+    bool canRedo() const;
+    QString undoText() const;
+    QString redoText() const;
+
+signals:
+    void journalChanged();
+    void commentsChanged(const QStringList &comments);
 
 private:
-    bool setDate(int pk_uid, const QString &transactionDate);
+    typedef QHash<QPair<int,int>,double> LedgerDeltas;    //(id_account, yyyymm month) -> change in amount
+    typedef QVector<QVariant> Row;    //one shown row, a value per column
+
+    UndoJournal journal;
+    ExchangeRates rates;
+    int operationDepth;
+    bool operationFailed;
+    int lastInsertId;
+    int currentAccount;
+    QDate fromDate;
+    QDate toDate;
+    QVector<Row> rows;    //the loaded stretch of the shown rows, in the shown order
+    bool atStart;    //no shown rows come before the loaded ones
+    bool atEnd;    //no shown rows come after the loaded ones
+    bool stale;    //the account, date range or sort changed since the rows were read
+    bool loadAll;    //every load reads all the shown rows
+    bool hasSplitLines;    //the shown account is the target of split lines, which are listed with its rows
+    double closingTotal;    //the running total after the last shown row
+    QList<QPair<int,Qt::SortOrder> > sortKeys;
+    QHash<int, QVector<SplitLine> > splitCache;    //split lines of the loaded transactions, by parent pk_uid
+    QHash<int,QString> accountNames;
+    bool setDate(int pk_uid, const QDate &transactionDate);
+    static bool migrateDates();
+    QString rowSource() const;
+    double closingBalance() const;
+    QString dateFilter(const QString &alias) const;
+    void bindDateRange(QSqlQuery &q) const;
+    static void bindValues(QSqlQuery &q, const QVariantMap &binds);
     bool setComment(int pk_uid, const QString &transactionComment);
     bool setAmount(int pk_uid, double &transactionAmount);
+    void beginOperation(const QString &description);
+    bool endOperation(bool success);
+    void emitCommentsChanged(const JournalEntry &entry);
+    bool updateField(int pk_uid, JournalEntry::Field field, const QVariant &value, const QVariant &relatedValue);
+    QVector<JournalRow> fetchRows(int pk_uid, bool includeRelated);
+    LedgerDeltas accountSums(const QList<int> &ids, const QList<int> &splitIds);
+    bool applyBalanceDeltas(const LedgerDeltas &deltas);
+    bool applyEntry(const JournalEntry &entry, bool forward);
+    bool insertRows(const QVector<JournalRow> &rows);
+    bool deleteRows(const QList<int> &ids);
+    bool insertSplits(const QVector<SplitLine> &lines);
+    bool deleteSplits(const QVector<SplitLine> &lines);
+    void loadSplits(const QVector<Row> &page);
+    void prepareRows();
+    void showRows(QVector<Row> &page, bool first, bool last);
+    QVector<Row> readPage(const QVariantList &keys, bool backward, bool inclusive, int limit) const;
+    QVariantList keysOf(const Row &row) const;
+    void placeTotals(QVector<Row> &page, bool appended) const;
+    void spanTotals(QVector<Row> &page) const;
+    QString dateSeek(const Row &row, bool earlier, bool inclusive, const QString &name, QVariantMap &binds) const;
+    static bool isLater(const Row &row, const Row &other);
+    QString selectRows() const;
+    bool isChronological() const;
+    QList<int> keyColumns() const;
+    QStringList keyTerms() const;
+    bool isDescending(int key) const;
+    QString orderBy(bool reversed) const;
+    bool keyValues(int pk_uid, QVariantList &values) const;
+    QString seekFilter(const QVariantList &values, bool backward, bool inclusive, QVariantMap &binds) const;
+    bool categorizeRows(const RuleMatcher &rules, QSqlQuery &q, int *moved);
+    bool applyChanges(const QVector<JournalEntry::Change> &changes, bool forward);
+    static QVariant rowValue(const JournalRow &row, JournalEntry::Field field);
+    static QString idList(const QList<int> &ids);
+    static int monthOf(const QVariant &julianDay);
+    static QDate monthStart(int month);
 };
 
 #endif // TRANSACTIONSMODEL_H
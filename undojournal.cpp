@@ -0,0 +1,249 @@
+#include <algorithm>
+#include "undojournal.h"
+
+/*
+ *  sorts the ids and drops the repeats
+ */
+static QList<int> uniqueIds(QList<int> ids)
+{
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    return ids;
+}
+
+bool JournalEntry::isEmpty() const
+{
+    return changes.isEmpty() && inserted.isEmpty() && deleted.isEmpty()
+            && splitsInserted.isEmpty() && splitsDeleted.isEmpty();
+}
+
+/*
+ *  returns the pk_uid of every trans row the entry touches
+ */
+QList<int> JournalEntry::touchedIds() const
+{
+    QList<int> ids;
+    for (int i = 0; i < changes.size(); ++i)
+    {
+        ids.append(changes.at(i).pk_uid);
+    }
+    for (int i = 0; i < inserted.size(); ++i)
+    {
+        ids.append(inserted.at(i).pk_uid);
+    }
+    for (int i = 0; i < deleted.size(); ++i)
+    {
+        ids.append(deleted.at(i).pk_uid);
+    }
+    return uniqueIds(ids);
+}
+
+/*
+ *  returns the pk_uid of every trans_split row the entry touches
+ */
+QList<int> JournalEntry::touchedSplitIds() const
+{
+    QList<int> ids;
+    for (int i = 0; i < splitsInserted.size(); ++i)
+    {
+        ids.append(splitsInserted.at(i).pk_uid);
+    }
+    for (int i = 0; i < splitsDeleted.size(); ++i)
+    {
+        ids.append(splitsDeleted.at(i).pk_uid);
+    }
+    return uniqueIds(ids);
+}
+
+const char *JournalEntry::columnName(Field field)
+{
+    switch (field)
+    {
+    case FieldAccount:
+        return "id_account";
+    case FieldDate:
+        return "date_trans";
+    case FieldComment:
+        return "comment";
+    case FieldAmount:
+        return "amount";
+    case FieldReconciled:
+        return "reconciled";
+    case FieldRelate:
+        return "id_relate";
+    }
+    return 0;
+}
+
+UndoJournal::UndoJournal() :
+    recording(false),
+    maxEntries(100)
+{
+}
+
+/*
+ *  starts collecting deltas for a new entry
+ */
+void UndoJournal::begin(const QString &description)
+{
+    current = JournalEntry();
+    current.description = description;
+    currentIndex.clear();
+    recording = true;
+}
+
+/*
+ *  pushes the collected entry onto the undo stack. a new operation
+ *  invalidates anything that could have been redone
+ */
+void UndoJournal::commit()
+{
+    recording = false;
+    currentIndex.clear();
+    if (current.isEmpty())
+    {
+        return;
+    }
+    pushUndo(current);
+    redoStack.clear();
+    current = JournalEntry();
+}
+
+void UndoJournal::discard()
+{
+    recording = false;
+    currentIndex.clear();
+    current = JournalEntry();
+}
+
+/*
+ *  the entry being recorded, before commit() moves it onto the undo stack
+ */
+JournalEntry UndoJournal::currentEntry() const
+{
+    return current;
+}
+
+bool UndoJournal::isRecording() const
+{
+    return recording;
+}
+
+/*
+ *  records a field change. if the same field of the same row was already changed
+ *  in this entry, only the after value moves forward so the entry stays one delta per field
+ */
+void UndoJournal::recordChange(int pk_uid, JournalEntry::Field field, const QVariant &before, const QVariant &after)
+{
+    if (!recording)
+    {
+        return;
+    }
+    QPair<int,int> key(pk_uid, field);
+    if (currentIndex.contains(key))
+    {
+        current.changes[currentIndex.value(key)].after = after;
+        return;
+    }
+    JournalEntry::Change c;
+    c.pk_uid = pk_uid;
+    c.field = field;
+    c.before = before;
+    c.after = after;
+    currentIndex.insert(key, current.changes.size());
+    current.changes.append(c);
+}
+
+void UndoJournal::recordInsert(const JournalRow &row)
+{
+    if (recording)
+    {
+        current.inserted.append(row);
+    }
+}
+
+void UndoJournal::recordDelete(const JournalRow &row)
+{
+    if (recording)
+    {
+        current.deleted.append(row);
+    }
+}
+
+void UndoJournal::recordSplitInsert(const SplitLine &line)
+{
+    if (recording)
+    {
+        current.splitsInserted.append(line);
+    }
+}
+
+void UndoJournal::recordSplitDelete(const SplitLine &line)
+{
+    if (recording)
+    {
+        current.splitsDeleted.append(line);
+    }
+}
+
+bool UndoJournal::canUndo() const
+{
+    return !undoStack.isEmpty();
+}
+
+bool UndoJournal::canRedo() const
+{
+    return !redoStack.isEmpty();
+}
+
+QString UndoJournal::undoText() const
+{
+    return undoStack.isEmpty() ? QString() : undoStack.last().description;
+}
+
+QString UndoJournal::redoText() const
+{
+    return redoStack.isEmpty() ? QString() : redoStack.last().description;
+}
+
+JournalEntry UndoJournal::takeUndo()
+{
+    return undoStack.takeLast();
+}
+
+JournalEntry UndoJournal::takeRedo()
+{
+    return redoStack.takeLast();
+}
+
+void UndoJournal::pushUndo(const JournalEntry &entry)
+{
+    undoStack.append(entry);
+    while (undoStack.size() > maxEntries)
+    {
+        undoStack.removeFirst();
+    }
+}
+
+void UndoJournal::pushRedo(const JournalEntry &entry)
+{
+    redoStack.append(entry);
+}
+
+/*
+ *  forgets every entry, for when the rows they refer to can no longer be restored
+ */
+void UndoJournal::clear()
+{
+    undoStack.clear();
+    redoStack.clear();
+}
+
+void UndoJournal::setMaxEntries(int entries)
+{
+    maxEntries = entries;
+    while (undoStack.size() > maxEntries)
+    {
+        undoStack.removeFirst();
+    }
+}
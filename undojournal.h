@@ -0,0 +1,101 @@
+#ifndef UNDOJOURNAL_H
+#define UNDOJOURNAL_H
+
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+
+/*
+ *  a complete trans row, used to restore deleted rows and replay inserted ones
+ */
+struct JournalRow
+{
+    int pk_uid;
+    int id_account;
+    QVariant date_trans;
+    QString comment;
+    double amount;
+    QVariant id_relate;
+    int reconciled;
+};
+
+/*
+ *  one line of a split transaction (a trans_split row). the lines of a split add up to the
+ *  parent's amount and affect their own account's balance like the mirror leg of a transfer
+ */
+struct SplitLine
+{
+    int pk_uid;
+    int id_trans;
+    int id_account;
+    QString comment;
+    double amount;
+};
+
+/*
+ *  one undoable operation. field edits are stored as before/after deltas,
+ *  whole rows are only kept for inserts and deletes
+ */
+struct JournalEntry
+{
+    enum Field { FieldAccount, FieldDate, FieldComment, FieldAmount, FieldReconciled, FieldRelate };
+
+    struct Change
+    {
+        int pk_uid;
+        Field field;
+        QVariant before;
+        QVariant after;
+    };
+
+    QString description;
+    QVector<Change> changes;
+    QVector<JournalRow> inserted;
+    QVector<JournalRow> deleted;
+    QVector<SplitLine> splitsInserted;
+    QVector<SplitLine> splitsDeleted;
+
+    bool isEmpty() const;
+    QList<int> touchedIds() const;
+    QList<int> touchedSplitIds() const;
+    static const char *columnName(Field field);
+};
+
+class UndoJournal
+{
+public:
+    UndoJournal();
+    void begin(const QString &description);
+    void commit();
+    void discard();
+    bool isRecording() const;
+    JournalEntry currentEntry() const;
+    void recordChange(int pk_uid, JournalEntry::Field field, const QVariant &before, const QVariant &after);
+    void recordInsert(const JournalRow &row);
+    void recordDelete(const JournalRow &row);
+    void recordSplitInsert(const SplitLine &line);
+    void recordSplitDelete(const SplitLine &line);
+    bool canUndo() const;
+    bool canRedo() const;
+    QString undoText() const;
+    QString redoText() const;
+    JournalEntry takeUndo();
+    JournalEntry takeRedo();
+    void pushUndo(const JournalEntry &entry);
+    void pushRedo(const JournalEntry &entry);
+    void setMaxEntries(int entries);
+    void clear();
+
+private:
+    QList<JournalEntry> undoStack;
+    QList<JournalEntry> redoStack;
+    JournalEntry current;
+    QHash<QPair<int,int>, int> currentIndex;    //(pk_uid, field) -> position in current.changes
+    bool recording;
+    int maxEntries;
+};
+
+#endif // UNDOJOURNAL_H